@@ -553,6 +553,9 @@ static void do_help() {
    cout << "resign:          resign the current game" << endl;
    cout << "result <string>: set the game result (0-1, 1/2-1/2 or 1-0)" << endl;
    cout << "sd <x>:          limit thinking to depth x" << endl;
+#ifdef SMP_STATS
+   cout << "smpstats:        show per-thread statistics for the last search" << endl;
+#endif
    cout << "setboard <FEN>:  set board to a specified FEN string" << endl;
    cout << "st <x>:          limit thinking to x seconds" << endl;
    cout << "time <int>:      set computer time remaining (in centiseconds)" << endl;
@@ -561,6 +564,7 @@ static void do_help() {
    cout << "test <file> <-t seconds> <-x # moves> <-v> <-o outfile>: "<< endl;
    cout << "   - run an EPD testsuite" << endl;
    cout << "eval <file>:     evaluate a FEN position." << endl;
+   cout << "evalbench <file>: time static eval of EPD file positions" << endl;
    cout << "perft <depth>:   compute perft value for a given depth" << endl;
 }
 
@@ -2042,6 +2046,7 @@ static void do_test(string test_file)
    delayedInitIfNeeded();
    int tmp = options.book.book_enabled;
    options.book.book_enabled = 0;
+   searcher->clearHashStats();
    total_nodes = (uint64)0;
    total_correct = total_tests = 0;
    total_time = (uint64)0;
@@ -2247,6 +2252,10 @@ static void do_test(string test_file)
          cout << avg << "depth to solution : " << (float)(depth_to_find_total)/total_correct << endl;
          cout << avg << "time to solution  : " << (float)(time_to_find_total)/(1000.0*total_correct) << " sec." << endl;
    }
+   HashStats hashStats;
+   searcher->getHashStats(hashStats);
+   cout << endl;
+   hashStats.print(cout);
    options.book.book_enabled = tmp;
    testing = 0;
 }
@@ -2272,6 +2281,65 @@ static uint64 perft(Board &board, int depth) {
    return nodes;
 }
 
+// for support of the "evalbench" command: time the static eval of
+// the positions in an EPD file, one at a time and as a batch
+static void evalBench(const string &filename) {
+   ifstream pos_file(filename.c_str(), ios::in);
+   if (!pos_file.good()) {
+      cout << "Failed to open EPD file." << endl;
+      return;
+   }
+   vector<Board> boards;
+   string buf;
+   while (std::getline(pos_file,buf)) {
+      stringstream stream(buf);
+      Board board;
+      EPDRecord epd_rec;
+      if (!ChessIO::readEPDRecord(stream,board,epd_rec)) break;
+      if (epd_rec.hasError()) {
+         cerr << "error in EPD record: " << epd_rec.getError() << endl;
+      } else {
+         boards.push_back(board);
+      }
+   }
+   const int n = (int)boards.size();
+   if (n == 0) {
+      cerr << "no positions read from " << filename << endl;
+      return;
+   }
+   delayedInitIfNeeded();
+   Scoring *s = new Scoring(options.search);
+   // repeat the set so each timing covers at least 500000 evals.
+   // Tables are cleared before each pass, as for a fresh set.
+   const int passes = Util::Max(1,500000/n);
+   vector<int> scalar(n), batch(n);
+   uint64 scalarNanos = 0ULL, batchNanos = 0ULL;
+   for (int pass = 0; pass < passes; pass++) {
+      s->clearHashTables();
+      uint64 start = getCurrentNanos();
+      for (int i = 0; i < n; i++) {
+         scalar[i] = s->evalu8(boards[i]);
+      }
+      scalarNanos += getCurrentNanos() - start;
+      s->clearHashTables();
+      start = getCurrentNanos();
+      s->evaluateBatch(&boards[0],n,&batch[0]);
+      batchNanos += getCurrentNanos() - start;
+   }
+   delete s;
+   int errs = 0;
+   for (int i = 0; i < n; i++) {
+      if (scalar[i] != batch[i]) ++errs;
+   }
+   const double evals = double(n)*passes;
+   cout << n << " positions, " << passes << " passes" << endl;
+   cout << "scalar: " << setprecision(4) << scalarNanos/evals << " ns/position" << endl;
+   cout << "batch:  " << setprecision(4) << batchNanos/evals << " ns/position" << endl;
+   if (errs) {
+      cout << errs << " position(s) scored differently by batch eval" << endl;
+   }
+}
+
 static void loadgame(Board &board,ifstream &file) {
     vector<ChessIO::Header> hdrs(20);
     long first;
@@ -2434,6 +2502,7 @@ static bool do_command(const string &cmd, Board &board) {
         verbose = 1;                       // TBD: fixed for now
         // Learning is disabled because we don't have full game history w/ scores
         options.learning.position_learning = 0;
+        searcher->updateSearchOptions();
         cout << "id name " << "Arasan " << Arasan_Version;
         cout << endl;
         cout << "id author Jon Dart" << endl;
@@ -2443,6 +2512,14 @@ static bool do_command(const string &cmd, Board &board) {
             "64000" << endl;
 #else
             "2000" << endl;
+#endif
+        cout << "option name Pawn Hash type spin default " <<
+            options.search.pawn_hash_size/(1024L*1024L) << " min 1 max 256" << endl;
+#ifdef __linux__
+        cout << "option name Large pages type check default " <<
+            (options.search.large_pages ? "true" : "false") << endl;
+        cout << "option name NUMA interleave type check default " <<
+            (options.search.numa_interleave ? "true" : "false") << endl;
 #endif
         cout << "option name Ponder type check default true" << endl;
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS)
@@ -2480,6 +2557,18 @@ static bool do_command(const string &cmd, Board &board) {
         cout << "option name Threads type spin default " <<
             options.search.ncpus << " min 1 max " <<
             Constants::MaxCPUs << endl;
+        cout << "option name Lazy SMP type check default " <<
+            (options.search.lazy_smp ? "true" : "false") << endl;
+#if defined(_WIN32) || defined(__linux__)
+        cout << "option name Thread affinity type combo default " <<
+            options.search.thread_affinity << " var " <<
+            Options::AFFINITY_NONE << " var " <<
+            Options::AFFINITY_SEQUENTIAL << " var " <<
+            Options::AFFINITY_COMPACT << " var " <<
+            Options::AFFINITY_SCATTER << endl;
+#endif
+        cout << "option name Spin wait type spin default " <<
+            options.search.spin_wait << " min 0 max 1000" << endl;
         cout << "option name UCI_LimitStrength type check default false" << endl;       cout << "option name UCI_Elo type spin default " <<
             1000+options.search.strength*16 << " min 1000 max 2600" << endl;
         cout << "uciok" << endl;
@@ -2522,6 +2611,18 @@ static bool do_command(const string &cmd, Board &board) {
                 }
             }
         }
+#ifdef __linux__
+        else if (name == "Large pages" || name == "NUMA interleave") {
+            int &opt = (name == "Large pages") ? options.search.large_pages :
+                options.search.numa_interleave;
+            int old = opt;
+            opt = (value == "true");
+            if (old != opt) {
+                // reallocate with the new settings
+                searcher->resizeHash(options.search.hash_table_size);
+            }
+        }
+#endif
         else if (name == "Ponder") {
             easy = !(value == "true");
         }
@@ -2594,6 +2695,31 @@ static bool do_command(const string &cmd, Board &board) {
                 searcher->setThreadCount(options.search.ncpus);
             }
         }
+        else if (name == "Lazy SMP") {
+            options.search.lazy_smp = (value == "true");
+        }
+#if defined(_WIN32) || defined(__linux__)
+        else if (name == "Thread affinity") {
+            // applied by updateSearchOptions, below
+            if (Options::validAffinity(value)) {
+                options.search.thread_affinity = value;
+            }
+        }
+#endif
+        else if (name == "Pawn Hash") {
+            // size is in megabytes, per search thread. Applied by
+            // updateSearchOptions, below.
+            int size = int(options.search.pawn_hash_size/(1024L*1024L));
+            if (Options::setOption<int>(value,size) && size >= 1 && size <= 256) {
+                options.search.pawn_hash_size = (size_t)size*1024L*1024L;
+            }
+        }
+        else if (name == "Spin wait") {
+            int spin = options.search.spin_wait;
+            if (Options::setOption<int>(value,spin) && spin >= 0 && spin <= 1000) {
+                options.search.spin_wait = spin;
+            }
+        }
         else if (name == "UCI_LimitStrength") {
             uci_limit_strength = (value == "true");
         } else if (name == "UCI_Elo" && uci_limit_strength) {
@@ -2617,6 +2743,8 @@ static bool do_command(const string &cmd, Board &board) {
     }
     else if (uci && cmd == "isready") {
         delayedInitIfNeeded();
+        // wait for any background hash clearing to finish
+        searcher->waitForHashClear();
         cout << "readyok" << endl;
 #ifdef UCI_LOG
         ucilog << "readyok" << endl;
@@ -2742,6 +2870,7 @@ static bool do_command(const string &cmd, Board &board) {
                 Options tmp = options;
                 options.book.book_enabled = 0;
                 options.learning.position_learning = 0;
+                searcher->updateSearchOptions();
                 do_test(filename);
                 if (out_file) {
                     out_file->close();
@@ -2749,6 +2878,7 @@ static bool do_command(const string &cmd, Board &board) {
                     cout.rdbuf(sbuf);               // restore console output
                 }
                 options = tmp;
+                searcher->updateSearchOptions();
                 searcher->registerPostFunction(old_post);
                 searcher->registerTerminateFunction(old_terminate);
                 cout << "test complete" << endl;
@@ -2759,6 +2889,30 @@ static bool do_command(const string &cmd, Board &board) {
         else
             cout << "invalid command" << endl;
     }
+    else if (cmd_word == "savehash" || cmd_word == "loadhash") {
+       if (cmd_args.length() == 0) {
+          cerr << "usage: " << cmd_word << " <file>" << endl;
+       }
+       else if (cmd_word == "savehash") {
+          if (searcher->saveHash(cmd_args)) {
+             cerr << "error saving hash table to " << cmd_args << endl;
+          }
+       }
+       else if (searcher->loadHash(cmd_args) == 0 && uci) {
+          cout << "info string hash table loaded from " << cmd_args << endl;
+       }
+    }
+    else if (cmd_word == "hashstats") {
+       if (cmd_args == "clear") {
+          searcher->clearHashStats();
+       }
+       else {
+          HashStats hashStats;
+          searcher->getHashStats(hashStats);
+          hashStats.print(cout);
+          cout << "hash table " << searcher->hashTable.pctFull()/10.0 << "% full" << endl;
+       }
+    }
     else if (cmd_word == "perft") {
        if (cmd_args.length()) {
           stringstream ss(cmd_args);
@@ -2774,6 +2928,13 @@ static bool do_command(const string &cmd, Board &board) {
           cerr << "usage: perft <depth>" << endl;
        }
     }
+    else if (cmd_word == "evalbench") {
+       if (cmd_args.length()) {
+          evalBench(cmd_args);
+       } else {
+          cerr << "usage: evalbench <file>" << endl;
+       }
+    }
     else if (cmd_word == "eval") {
         string filename;
         if (cmd_args.length()) {
@@ -2815,7 +2976,7 @@ static bool do_command(const string &cmd, Board &board) {
                 Scoring::init();
                 if (Scoring::isDraw(board))
                     cout << "position evaluates to draw (statically)" << endl;
-                Scoring *s = new Scoring();
+                Scoring *s = new Scoring(options.search);
                 s->init();
                 cout << board << endl;
                 Scoring::printScore(s->evalu8(board),cout);
@@ -2982,6 +3143,8 @@ static bool do_command(const string &cmd, Board &board) {
     }
     else if (cmd == "new") {
         if (!analyzeMode) save_game();
+        // write out positions learned in the last game
+        flushLearnRecordsInBackground();
         board.reset();
         theLog->clear();
         if (!uci) theLog->write_header();
@@ -3061,6 +3224,12 @@ static bool do_command(const string &cmd, Board &board) {
     else if (cmd == "hint") {
         doHint();
     }
+#ifdef SMP_STATS
+    else if (cmd == "smpstats") {
+        // per-thread statistics for the last search
+        searcher->printSmpStats(cout);
+    }
+#endif
     else if (cmd == "bk") {
         // list book moves
 	vector < pair<Move,int> > moves;
@@ -3565,7 +3734,7 @@ int CDECL main(int argc, char **argv) {
 
     for (int i = 0; i < 25; i++) {
        Board board;
-       Scoring s;
+       Scoring s(options.search);
        if (!BoardIO::readFEN(board, eval_fens[i])) {
           cerr << "invalid test position " << eval_fens[i] << endl;
        } else {
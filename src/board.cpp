@@ -28,6 +28,8 @@ const hash_t rep_codes[3] =
 
 static Board *initialBoard = NULL;
 
+PstScores Board::pstTable[16][64];
+
 void Board::setupInitialBoard() {
    initialBoard = (Board*)malloc(sizeof(Board));
    static PieceType pieces[] =
@@ -85,6 +87,8 @@ void Board::setSecondaryVars()
    occupied[White].clear();
    occupied[Black].clear();
    allOccupied.clear();
+   state.pst[White].mid = state.pst[White].end = 0;
+   state.pst[Black].mid = state.pst[Black].end = 0;
    for (i=0;i<64;i++)
    {
       Square sq(i);
@@ -95,6 +99,7 @@ void Board::setSecondaryVars()
          occupied[color].set(sq);
          allOccupied.set(sq);
          material[color].addPiece(TypeOfPiece(piece));
+         addPst(color,piece,sq);
          switch (TypeOfPiece(piece))
          {
          case King:
@@ -172,6 +177,20 @@ Board &Board::operator = (const Board &b)
    return *this;
 }
 
+void Board::copyForSplit(const Board &b)
+{
+   // Copy all contents except the repetition list
+   memcpy(&contents,&b.contents,(byte*)repList-(byte*)&contents);
+   // Repetition checks look back at most state.moveCount+1 entries
+   const int rep_entries = (int)(b.repListHead - b.repList);
+   int first = rep_entries - (b.state.moveCount+1);
+   if (first < 0) first = 0;
+   if (rep_entries > first) {
+       memcpy(repList+first,b.repList+first,sizeof(hash_t)*(rep_entries-first));
+   }
+   repListHead = repList + rep_entries;
+}
+
 Board::~Board()
 {
 }
@@ -275,6 +294,26 @@ void Board::doMove( Move move )
            }
    }
 #endif
+   // update the piece-square scores
+   if (moveType == KCastle) {
+      removePst(side,contents[start],start);
+      addPst(side,contents[start],start+2);
+      removePst(side,MakePiece(Rook,side),start+3);
+      addPst(side,MakePiece(Rook,side),start+1);
+   } else if (moveType == QCastle) {
+      removePst(side,contents[start],start);
+      addPst(side,contents[start],start-2);
+      removePst(side,MakePiece(Rook,side),start-4);
+      addPst(side,MakePiece(Rook,side),start-1);
+   } else {
+      removePst(side,contents[start],start);
+      addPst(side,moveType == Promotion ?
+             MakePiece(PromoteTo(move),side) : contents[start],dest);
+      if (Capture(move) != Empty) {
+         const Square target = moveType == EnPassant ? old_epsq : dest;
+         removePst(OppositeColor(side),contents[target],target);
+      }
+   }
    if (side == White)
    {
       if (moveType == KCastle)
@@ -747,6 +786,10 @@ void Board::doMove( Move move )
    // verify correct updating of bitmaps:
    Board copy(*this);
    copy.setSecondaryVars();
+   ASSERT(state.pst[White].mid == copy.state.pst[White].mid);
+   ASSERT(state.pst[White].end == copy.state.pst[White].end);
+   ASSERT(state.pst[Black].mid == copy.state.pst[Black].mid);
+   ASSERT(state.pst[Black].end == copy.state.pst[Black].end);
    ASSERT(pawn_bits[White] == copy.pawn_bits[White]);
    ASSERT(knight_bits[White] == copy.knight_bits[White]);
    ASSERT(bishop_bits[White] == copy.bishop_bits[White]);
@@ -24,12 +24,20 @@ enum CastleType { CanCastleEitherSide,
           
 enum CheckStatusType { NotInCheck, InCheck, CheckUnknown };
 
+// Piece-square table scores (midgame and endgame) for one side
+struct PstScores {
+   int32 mid, end;
+};
+
 struct BoardState {
    hash_t hashCode;
    Square enPassantSq;
    int moveCount;
    CheckStatusType checkStatus;
    CastleType castleStatus[2];
+   // running piece-square scores for each side (kept in the state so
+   // undoMove and undoNull restore them)
+   PstScores pst[2];
 };
 
 class Board
@@ -51,6 +59,15 @@ public:
    Board(const Board &);
    Board &operator = (const Board &);
 
+   // Copy the position from b, but only the part of the repetition
+   // list that repetition detection can reach (the positions since
+   // the last irreversible move), at the same offsets as in b. Used
+   // when splitting the search, where the cost of operator = would
+   // grow with the length of the game. The copy must not undo moves
+   // made before b's position unless it already held the same game
+   // history, as a split point's master does.
+   void copyForSplit(const Board &b);
+
    // resets board to initial position
    void reset();
 
@@ -392,6 +409,11 @@ public:
    hash_t repList[RepListSize]; //  move history for repetition detection
    hash_t *repListHead; // head of history list
 
+   // Piece-square scores by piece and square, from the perspective of
+   // the side owning the piece. Filled in by Scoring::init, which must
+   // run before any Board is set up.
+   static PstScores pstTable[16][64];
+
 private:
 
    static void setupInitialBoard();
@@ -402,6 +424,16 @@ private:
    void undoCastling(Square kp, Square oldkingsq,
            Square newrooksq, Square oldrooksq);
 
+   void addPst(ColorType color, Piece piece, Square sq) {
+      state.pst[color].mid += pstTable[piece][sq].mid;
+      state.pst[color].end += pstTable[piece][sq].end;
+   }
+
+   void removePst(ColorType color, Piece piece, Square sq) {
+      state.pst[color].mid -= pstTable[piece][sq].mid;
+      state.pst[color].end -= pstTable[piece][sq].end;
+   }
+
    void setAll(ColorType color, Square sq) {
      allOccupied.set(sq);
      occupied[color].set(sq);
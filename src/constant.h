@@ -12,7 +12,7 @@ enum {MaxPly = 62};
 enum {MATE = 100000 };
 enum {MATE_RANGE = 100000-256 };
 enum {MaxMoves = 200};		
-enum {MaxCPUs = 64};		
+enum {MaxCPUs = 256};		
 enum {HISTORY_MAX =32768};
 
 };
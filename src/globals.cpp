@@ -5,6 +5,8 @@
 #include "bitprobe.h"
 #include "scoring.h"
 #include "tbprobe.h"
+#include "learn.h"
+#include "threadp.h"
 #include "bitbase.cpp"
 #ifdef GAVIOTA_TBS
 #include "gtb.h"
@@ -24,7 +26,7 @@ LockDefine(input_lock);
 Tune tune_params;
 #endif
 
-static const char * LEARN_FILE_NAME = "arasan.lrn";
+static const char * LEARN_FILE_NAME = "arasan.lrb";
 
 static const char * DEFAULT_BOOK_NAME = "book.bin";
 
@@ -56,6 +58,8 @@ string derivePath(const char *base, const char *fileName) {
 
 int initGlobals(const char *pathName, bool initLog) {
    programPath = pathName;
+   initLearning();
+   ThreadPool::init();
    gameMoves = new MoveArray();
    if (initLog) {
        theLog = new Log();
@@ -71,6 +75,9 @@ int initGlobals(const char *pathName, bool initLog) {
 }
 
 void CDECL cleanupGlobals(void) {
+   flushLearnRecords();
+   cleanupLearning();
+   ThreadPool::cleanup();
    openingBook.close();
    delete gameMoves;
    delete theLog;
@@ -7,6 +7,7 @@
 #include "globals.h"
 #include "legal.h"
 #include "learn.h"
+#include "movegen.h"
 #include "scoring.h"
 extern "C"
 {
@@ -15,57 +16,290 @@ extern "C"
 #endif
 #include <memory.h>
 #include <stddef.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 };
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+// from linux/mempolicy.h (not always installed)
+static const int ARASAN_MPOL_INTERLEAVE = 3;
+static const int ARASAN_MPOL_F_MEMS_ALLOWED = (1<<2);
+static const int MAX_NUMA_NODES = 1024;
+
+static void logMessage(const string &msg)
+{
+   if (theLog) {
+      theLog->write(msg);
+      theLog->write_eol();
+   }
+}
+
+// Spread the pages of a mapping across all NUMA nodes we are
+// allowed to use. Must be done before the pages are first touched.
+static void interleaveNodes(void *addr, size_t bytes)
+{
+   unsigned long nodes[MAX_NUMA_NODES/(8*sizeof(unsigned long))];
+   memset(nodes,'\0',sizeof(nodes));
+   if (syscall(SYS_get_mempolicy,NULL,nodes,(unsigned long)MAX_NUMA_NODES,
+               NULL,ARASAN_MPOL_F_MEMS_ALLOWED) != 0) {
+      logMessage("hash: cannot get NUMA node list, interleave not done");
+      return;
+   }
+   int count = 0;
+   for (unsigned i = 0; i < sizeof(nodes)/sizeof(unsigned long); i++) {
+      count += __builtin_popcountl(nodes[i]);
+   }
+   stringstream s;
+   if (syscall(SYS_mbind,addr,(unsigned long)bytes,ARASAN_MPOL_INTERLEAVE,
+               nodes,(unsigned long)MAX_NUMA_NODES,0) != 0) {
+      s << "hash: NUMA interleave failed";
+   } else {
+      s << "hash: memory interleaved across " << count << " NUMA node(s)";
+   }
+   logMessage(s.str());
+}
+
+// Map memory for the hash table, using huge pages if enabled. Returns
+// NULL if the mapping failed.
+static void *mapHashMemory(size_t bytes, int largePages, int numaInterleave)
+{
+   void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+   if (largePages) {
+      // explicit huge pages: only available if the administrator
+      // has reserved them (vm.nr_hugepages)
+      p = mmap(NULL,bytes,PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+   }
+#endif
+   if (p == MAP_FAILED) {
+      p = mmap(NULL,bytes,PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+      if (p == MAP_FAILED) {
+         return NULL;
+      }
+#ifdef MADV_HUGEPAGE
+      // fall back to transparent huge pages
+      if (largePages) {
+         madvise(p,bytes,MADV_HUGEPAGE);
+      }
+#endif
+   }
+   if (numaInterleave) {
+      interleaveNodes(p,bytes);
+   }
+   return p;
+}
+
+// Report the page size the kernel actually gave us for the mapping
+// at addr. Pages must have been touched already.
+static void logPageSize(void *addr)
+{
+   ifstream smaps("/proc/self/smaps");
+   string line;
+   bool found = false;
+   size_t pageSize = 0, hugeBytes = 0, totalBytes = 0;
+   while (getline(smaps,line)) {
+      if (!found) {
+         stringstream s(line);
+         unsigned long long start;
+         if ((s >> hex >> start) && (void*)start == addr) {
+            found = true;
+         }
+         continue;
+      }
+      stringstream s(line);
+      string field;
+      size_t val;
+      s >> field >> val;
+      if (s.fail()) break; // start of next mapping
+      if (field == "Size:") totalBytes = val;
+      else if (field == "KernelPageSize:") pageSize = val;
+      else if (field == "AnonHugePages:") hugeBytes = val;
+   }
+   stringstream msg;
+   if (!found) {
+      msg << "hash: page size unknown";
+   } else {
+      msg << "hash: page size " << pageSize << " kB";
+      if (hugeBytes) {
+         msg << ", " << hugeBytes << " of " << totalBytes <<
+            " kB in transparent huge pages";
+      }
+   }
+   logMessage(msg.str());
+}
+#endif
 
 Hash::Hash() {
    hashTable = NULL;
    hashSize = 0;
    hashMask = 0x0ULL;
-   hashFree = 0;
    hash_init_done = 0;
+   mapped = 0;
+   untouched = 0;
+   oldTable = NULL;
+   oldBuckets = 0;
+   oldMapped = 0;
+   resizeAge = 0;
+   largePages = 0;
+   numaInterleave = 0;
+}
+
+void Hash::setMemoryOptions(int large_pages, int numa_interleave)
+{
+   largePages = large_pages;
+   numaInterleave = numa_interleave;
 }
 
 void Hash::initHash(size_t bytes)
 {
    if (!hash_init_done) {
-      hashSize = (int)(bytes/sizeof(HashEntry));
-      if (!hashSize) {
+      allocHash(bytes);
+      clearHash();
+   }
+}
+
+void Hash::allocHash(size_t bytes)
+{
+   if (!hash_init_done) {
+      size_t buckets = bytes/sizeof(HashBucket);
+      if (!buckets) {
+         hashSize = 0;
          hashMask = 0;
          hash_init_done++;
          return;
       }
       int hashPower;
       for (hashPower = 1; hashPower < 32; hashPower++) {
-        if (((size_t)1 << hashPower) > hashSize) {
+        if (((size_t)1 << hashPower) > buckets) {
             hashPower--;
             break;
         }
       }
-      hashSize = (size_t)1 << hashPower;
-      hashMask = (uint64)(hashSize-1);
-      size_t hashSizePlus = hashSize + MaxRehash;
-      ALIGNED_MALLOC(hashTable,
-         HashEntry,
-         sizeof(HashEntry)*hashSizePlus,128);
+      buckets = (size_t)1 << hashPower;
+      hashMask = (uint64)(buckets-1);
+      hashSize = buckets*HashBucket::EntriesPerBucket;
+      hashTable = NULL;
+      mapped = 0;
+#ifdef __linux__
+      if (largePages || numaInterleave) {
+         hashTable = (HashBucket*)mapHashMemory(sizeof(HashBucket)*buckets,
+                                                largePages,numaInterleave);
+         mapped = (hashTable != NULL);
+      }
+#endif
+      if (hashTable == NULL) {
+         ALIGNED_MALLOC(hashTable,
+            HashBucket,
+            sizeof(HashBucket)*buckets,128);
+      }
       if (hashTable == NULL) {
           cerr << "hash table allocation failed!" << endl;
           hashSize = 0;
       }
-      clearHash();
+      untouched = 1;
       hash_init_done++;
    }
 }
 
-void Hash::resizeHash(size_t bytes)
+void Hash::resizeHash(size_t bytes, int age)
+{
+   beginResize(bytes,age);
+   resizeSlice(0,1);
+   resizeDone();
+}
+
+
+void Hash::beginResize(size_t bytes, int age)
+{
+   ASSERT(oldTable == NULL);
+   if (hashSize) {
+      oldTable = hashTable;
+      oldBuckets = (size_t)hashMask+1;
+      oldMapped = mapped;
+   }
+   hashTable = NULL;
+   mapped = 0;
+   hash_init_done = 0;
+   resizeAge = age;
+   allocHash(bytes);
+}
+
+
+void Hash::resizeSlice(unsigned slice, unsigned slices)
+{
+   if (hashSize == 0) return;
+   const size_t buckets = (size_t)hashMask+1;
+   const size_t start = buckets*slice/slices;
+   const size_t end = buckets*(slice+1)/slices;
+   memset((void*)(hashTable+start),'\0',(end-start)*sizeof(HashBucket));
+   if (oldTable == NULL) return;
+   // Each slice fills a range of new buckets from the old buckets
+   // that map to them, so slices never write the same bucket.
+   for (size_t i = start; i < end; i++) {
+      // If the table grows, the old bucket maps to several new
+      // ones, and the entry is copied to each (see growCopy).
+      // If it shrinks, several old buckets map to this one and
+      // insertEntry keeps the most valuable entries.
+      for (size_t j = i & (oldBuckets-1); j < oldBuckets; j += buckets) {
+         for (int k = 0; k < HashBucket::EntriesPerBucket; k++) {
+            const HashEntry &entry = oldTable[j].entries[k];
+            if (entry.empty()) continue;
+            if (buckets > oldBuckets) {
+               insertEntry(hashTable[i],growCopy(entry,i,oldBuckets,buckets),
+                           resizeAge);
+            } else {
+               insertEntry(hashTable[i],entry,resizeAge);
+            }
+         }
+      }
+   }
+}
+
+
+void Hash::resizeDone()
 {
-   freeHash();
-   initHash(bytes);
+   if (oldTable != NULL) {
+      freeTable(oldTable,oldBuckets,oldMapped);
+      oldTable = NULL;
+      oldBuckets = 0;
+      oldMapped = 0;
+   }
+   if (hashSize == 0) return;
+#ifdef __linux__
+   if (mapped && untouched) {
+      logPageSize(hashTable);
+   }
+#endif
+   untouched = 0;
+}
+
+
+void Hash::freeTable(HashBucket *table, size_t buckets, int mapped)
+{
+#ifdef __linux__
+   if (mapped) {
+      munmap(table,buckets*sizeof(HashBucket));
+   }
+   else
+#endif
+   ALIGNED_FREE(table);
 }
 
 
 void Hash::freeHash()
 {
-   ALIGNED_FREE(hashTable);
+   freeTable(hashTable,(size_t)hashMask+1,mapped);
+   mapped = 0;
+   hashTable = NULL;
    hash_init_done = 0;
 }
 
@@ -73,38 +307,323 @@ void Hash::freeHash()
 void Hash::clearHash()
 {
    if (hashSize == 0) return;
-   size_t hashSizePlus = hashSize + MaxRehash;
-   hashFree = hashSize;
-   memset(hashTable,'\0',hashSizePlus*sizeof(HashEntry));
-   if (options.learning.position_learning) {
-      loadLearnInfo();
-    }
-}
-
-
-void Hash::loadLearnInfo()
-{
-   if (hashSize && options.learning.position_learning) {
-      ifstream plog;
-      plog.open(learnFileName.c_str(),ios_base::in);
-      while (plog.good() && !plog.eof()) {
-         LearnRecord rec;
-         if (getLearnRecord(plog,rec)) {
-            Move best = NullMove;
-            if (rec.start != InvalidSquare)
-               best = CreateMove(rec.start,rec.dest,rec.promotion);
-            storeHash(rec.hashcode,rec.depth*DEPTH_INCREMENT,
-               0,                                 /* age */
-               HashEntry::Valid,
-               rec.score,
-                      Scoring::INVALID_SCORE, // TBD
-                      HashEntry::LEARNED_MASK |
-                      (IsForced(best) ? HashEntry::FORCED_MASK : 0) |
-                      (IsForced2(best) ? HashEntry::FORCED2_MASK : 0),
-               best);
+   clearSlice(0,1);
+   clearDone();
+}
+
+
+void Hash::clearSlice(unsigned slice, unsigned slices)
+{
+   if (hashSize == 0) return;
+   const size_t buckets = (size_t)hashMask+1;
+   const size_t start = buckets*slice/slices;
+   const size_t end = buckets*(slice+1)/slices;
+   memset((void*)(hashTable+start),'\0',(end-start)*sizeof(HashBucket));
+}
+
+
+void Hash::clearDone()
+{
+   if (hashSize == 0) return;
+#ifdef __linux__
+   if (mapped && untouched) {
+      logPageSize(hashTable);
+   }
+#endif
+   untouched = 0;
+}
+
+
+// Collect the hash codes of "board" and the positions up to "ply"
+// more plies from it, as they are stored in the learn file.
+static void learnHashCodes(Board &board, int ply, vector<hash_t> &hashcodes)
+{
+   hashcodes.push_back(board.hashCode(board.repCount()));
+   if (ply == 0) return;
+   RootMoveGenerator mg(board);
+   Move m;
+   BoardState state = board.state;
+   int order = 0;
+   while ((m = mg.nextMove(order)) != NullMove) {
+      board.doMove(m);
+      learnHashCodes(board,ply-1,hashcodes);
+      board.undoMove(m,state);
+   }
+}
+
+void Hash::loadLearnInfo(const Board &board)
+{
+   if (hashSize) {
+      Board b(board);
+      vector<hash_t> hashcodes;
+      learnHashCodes(b,LEARN_PLY,hashcodes);
+      vector<LearnRecord> records;
+      findLearnRecords(hashcodes,records);
+      for (size_t i = 0; i < records.size(); i++) {
+         const LearnRecord &rec = records[i];
+         Move best = NullMove;
+         if (rec.start != InvalidSquare)
+            best = CreateMove(rec.start,rec.dest,rec.promotion);
+         storeHash(rec.hashcode,rec.depth*DEPTH_INCREMENT,
+            0,                                 /* age */
+            HashEntry::Valid,
+            rec.score,
+                   Scoring::INVALID_SCORE, // TBD
+                   HashEntry::LEARNED_MASK |
+                   (IsForced(best) ? HashEntry::FORCED_MASK : 0) |
+                   (IsForced2(best) ? HashEntry::FORCED2_MASK : 0),
+            best);
+      }
+   }
+}
+
+
+
+
+// Header for saved hash files. The header is followed by the
+// buckets, exactly as laid out in memory, so a saved table can be
+// read or mapped without any conversion.
+struct HashFileHeader {
+   char magic[8];
+   uint32 version;
+   uint32 byteOrder;
+   uint32 entrySize;
+   uint32 bucketSize;
+   uint64 buckets;
+   char pad[32];
+};
+
+static const char HASH_FILE_MAGIC[8] = {'A','r','a','s','a','n','T','T'};
+static const uint32 HASH_FILE_VERSION = 1;
+static const uint32 HASH_FILE_BYTE_ORDER = 0x01020304;
+// buckets per read or write
+static const size_t HASH_FILE_CHUNK = 16384;
+
+int Hash::saveHash(const string &fileName) const
+{
+   if (hashSize == 0) return -1;
+   ofstream out(fileName.c_str(), ios::out | ios::trunc | ios::binary);
+   HashFileHeader header;
+   memset(&header,'\0',sizeof(HashFileHeader));
+   memcpy(header.magic,HASH_FILE_MAGIC,sizeof(header.magic));
+   header.version = HASH_FILE_VERSION;
+   header.byteOrder = HASH_FILE_BYTE_ORDER;
+   header.entrySize = sizeof(HashEntry);
+   header.bucketSize = sizeof(HashBucket);
+   header.buckets = hashMask+1;
+   out.write((const char*)&header,sizeof(HashFileHeader));
+   for (size_t i = 0; i < header.buckets && !out.fail();
+        i += HASH_FILE_CHUNK) {
+      size_t n = Util::Min(HASH_FILE_CHUNK,(size_t)header.buckets-i);
+      out.write((const char*)(hashTable+i),n*sizeof(HashBucket));
+   }
+   out.close();
+   return out.fail() ? -1 : 0;
+}
+
+int Hash::loadHash(const string &fileName, int age)
+{
+   if (hashSize == 0) return -1;
+   ifstream in(fileName.c_str(), ios::in | ios::binary);
+   HashFileHeader header;
+   in.read((char*)&header,sizeof(HashFileHeader));
+   if (in.fail() ||
+       memcmp(header.magic,HASH_FILE_MAGIC,sizeof(header.magic)) ||
+       header.version != HASH_FILE_VERSION ||
+       header.byteOrder != HASH_FILE_BYTE_ORDER ||
+       header.entrySize != sizeof(HashEntry) ||
+       header.bucketSize != sizeof(HashBucket) ||
+       header.buckets == 0 || (header.buckets & (header.buckets-1))) {
+      cerr << "invalid or incompatible hash file: " << fileName << endl;
+      return -1;
+   }
+   const size_t buckets = hashMask+1;
+   const size_t oldBuckets = (size_t)header.buckets;
+   memset((void*)hashTable,'\0',buckets*sizeof(HashBucket));
+   HashBucket *buf = NULL;
+   if (oldBuckets != buckets) {
+      buf = new HashBucket[HASH_FILE_CHUNK];
+   }
+   for (size_t i = 0; i < oldBuckets; i += HASH_FILE_CHUNK) {
+      const size_t n = Util::Min(HASH_FILE_CHUNK,oldBuckets-i);
+      // same size tables are read directly into place
+      HashBucket *chunk = buf ? buf : hashTable+i;
+      in.read((char*)chunk,n*sizeof(HashBucket));
+      if (in.fail()) {
+         cerr << "error reading hash file: " << fileName << endl;
+         delete [] buf;
+         clearHash();
+         return -1;
+      }
+      for (size_t j = 0; j < n; j++) {
+         for (int k = 0; k < HashBucket::EntriesPerBucket; k++) {
+            HashEntry &entry = chunk[j].entries[k];
+            if (entry.empty()) continue;
+            // Ages in the file are from another session. Learned
+            // entries keep age 0, others get the age passed in.
+            if (entry.age()) entry.reAge(age);
+            if (buf) {
+               migrateEntry(entry,i+j,oldBuckets,age);
+            }
          }
       }
    }
+   delete [] buf;
+   return 0;
 }
 
+void Hash::migrateEntry(const HashEntry &entry, size_t oldIndex,
+                        size_t oldBuckets, int age)
+{
+   const size_t buckets = hashMask+1;
+   if (buckets <= oldBuckets) {
+      insertEntry(hashTable[oldIndex & hashMask],entry,age);
+   } else {
+      // The hash code bits that choose among these buckets are not
+      // stored in the entry, so copy it to every bucket it could
+      // belong in. Copies in the wrong buckets will not match any
+      // probe more often than any other stale entry, and are
+      // replaced first.
+      for (size_t i = oldIndex; i < buckets; i += oldBuckets) {
+         insertEntry(hashTable[i],growCopy(entry,i,oldBuckets,buckets),age);
+      }
+   }
+}
+
+void Hash::insertEntry(HashBucket &bucket, const HashEntry &entry, int age)
+{
+   // Use an empty slot if available, otherwise replace the least
+   // valuable entry (by the storeHash rating: older, then shallower),
+   // if the new entry is more valuable. Learned and tablebase entries
+   // are never replaced, and are kept in preference to others.
+   HashEntry *best = NULL;
+   int maxScore = (entry.flags() & (HashEntry::LEARNED_MASK | HashEntry::TB_MASK)) ?
+      -Constants::MaxPly*DEPTH_INCREMENT : replaceScore(entry,age);
+   for (int i = 0; i < HashBucket::EntriesPerBucket; i++) {
+      HashEntry &q = bucket.entries[i];
+      if (q.empty()) {
+         best = &q;
+         break;
+      }
+      else if (q.getEffectiveHash() == entry.getEffectiveHash()) {
+         // Same position, or a copy of the same entry made when
+         // the table grew: keep only the more valuable one.
+         if (replaceScore(q,age) > replaceScore(entry,age)) {
+            q = entry;
+         }
+         return;
+      }
+      else if (!(q.flags() &
+                 (HashEntry::LEARNED_MASK | HashEntry::TB_MASK))) {
+         int score = replaceScore(q,age);
+         if (score > maxScore) {
+            maxScore = score;
+            best = &q;
+         }
+      }
+   }
+   if (best != NULL) {
+      *best = entry;
+   }
+}
+
+int Hash::pctFull() const
+{
+   if (hashSize == 0) return 0;
+   // Entries are spread uniformly, so the start of the table is
+   // a good sample. Reads are not locked, so this is approximate
+   // while a search is running.
+   const size_t buckets = Util::Min((size_t)OCCUPANCY_SAMPLE,(size_t)hashMask+1);
+   size_t used = 0;
+   for (size_t i = 0; i < buckets; i++) {
+      for (int k = 0; k < HashBucket::EntriesPerBucket; k++) {
+         const HashEntry &entry = hashTable[i].entries[k];
+         if (!entry.empty() && !entry.stale()) used++;
+      }
+   }
+   return (int)((1000*used)/(buckets*HashBucket::EntriesPerBucket));
+}
 
+void HashStats::clear()
+{
+   memset(this,'\0',sizeof(HashStats));
+}
+
+HashStats & HashStats::operator += (const HashStats &s)
+{
+   probes += s.probes;
+   for (int i = 0; i <= HashEntry::NoHit; i++) {
+      results[i] += s.results[i];
+   }
+   collisions += s.collisions;
+   stores += s.stores;
+   emptyFills += s.emptyFills;
+   updates += s.updates;
+   for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < DEPTH_BINS; j++) {
+         replaced[i][j] += s.replaced[i][j];
+      }
+   }
+   evalProbes += s.evalProbes;
+   evalHits += s.evalHits;
+   materialProbes += s.materialProbes;
+   materialHits += s.materialHits;
+   pawnProbes += s.pawnProbes;
+   pawnHits += s.pawnHits;
+   kingPawnProbes += s.kingPawnProbes;
+   kingPawnHits += s.kingPawnHits;
+   return *this;
+}
+
+static void printCount(ostream &out, const char *label, uint64 count, uint64 total)
+{
+   out << label << count;
+   if (total) {
+      out << " (" << fixed << setprecision(2) << 100.0*count/total << "%)";
+   }
+   out << endl;
+}
+
+void HashStats::print(ostream &out) const
+{
+   const streamsize prec = out.precision();
+   static const char *resultNames[HashEntry::NoHit+1] = {
+      "valid", "upper bound", "lower bound", "eval", "insufficient depth",
+      "miss"};
+   out << "hash probes: " << probes << endl;
+   for (int i = 0; i <= HashEntry::NoHit; i++) {
+      out << "   ";
+      printCount(out,(string(resultNames[i]) + ": ").c_str(),results[i],probes);
+   }
+   printCount(out,"hash collisions: ",collisions,probes);
+   out << "hash stores: " << stores << endl;
+   out << "   ";
+   printCount(out,"to empty slot: ",emptyFills,stores);
+   out << "   ";
+   printCount(out,"same position: ",updates,stores);
+   static const char *ageNames[2] = {"current", "older"};
+   for (int i = 0; i < 2; i++) {
+      out << "replaced, " << ageNames[i] << " search, by depth:";
+      for (int j = 0; j < DEPTH_BINS; j++) {
+         out << ' ';
+         if (j) out << j; else out << 'q';
+         if (j == DEPTH_BINS-1) out << '+';
+         out << ':' << replaced[i][j];
+      }
+      out << endl;
+   }
+   out << "eval cache probes: " << evalProbes << endl;
+   out << "   ";
+   printCount(out,"hits: ",evalHits,evalProbes);
+   out << "material table probes: " << materialProbes << endl;
+   out << "   ";
+   printCount(out,"hits: ",materialHits,materialProbes);
+   out << "pawn hash probes: " << pawnProbes << endl;
+   out << "   ";
+   printCount(out,"hits: ",pawnHits,pawnProbes);
+   out << "king/pawn hash probes: " << kingPawnProbes << endl;
+   out << "   ";
+   printCount(out,"hits: ",kingPawnHits,kingPawnProbes);
+   out.unsetf(ios::fixed);
+   out.precision(prec);
+}
@@ -11,7 +11,12 @@
 
 extern const hash_t rep_codes[3];
 
-class HashEntry {
+// Two entry layouts are supported. The default stores a 32-bit key
+// and full-width scores in 20 bytes. If built with -DCOMPACT_HASH,
+// entries are 12 bytes, with a 24-bit key and 16-bit scores, so a
+// table of the same size holds 5/3 as many positions.
+class HashEntry
+BEGIN_PACKED_STRUCT
 
    public:
 
@@ -21,7 +26,9 @@ class HashEntry {
          TB_MASK = 0x08,
          LEARNED_MASK = 0x10,
          FORCED_MASK = 0x20,
-         FORCED2_MASK = 0x40
+         FORCED2_MASK = 0x40,
+         // extra copy made when the table grew (see Hash::resizeSlice)
+         STALE_MASK = 0x80
       };
 
       static const int QSEARCH_CHECK_DEPTH = -1;
@@ -42,14 +49,38 @@ class HashEntry {
          contents.depth = (byte)(depth+2);
          contents.age = age;
          contents.flags = type | flags;
+#ifdef COMPACT_HASH
+         contents.value = packScore(val);
+         contents.static_value = packScore(staticValue);
+         if (StartSquare(bestMove) == InvalidSquare) {
+            move = NO_MOVE;
+         } else {
+            move = (uint16)(StartSquare(bestMove) |
+                            (DestSquare(bestMove) << 6) |
+                            (PromoteTo(bestMove) << 12));
+         }
+#else
          contents.start = StartSquare(bestMove);
          contents.dest = DestSquare(bestMove);
          contents.promotion = PromoteTo(bestMove);
          values.value = val;
          values.static_value = staticValue;
+#endif
          setEffectiveHash(hash);
       }
 
+#ifdef COMPACT_HASH
+      // No stored move has start == dest, so a zero move field
+      // identifies a cleared entry.
+      int empty() const {
+         return move == 0;
+      }
+
+      void clear() {
+        hc = 0;
+        move = 0;
+      }
+#else
       int empty() const {
          return hc == 0x0ULL;
       }
@@ -57,11 +88,25 @@ class HashEntry {
       void clear() {
         hc = 0x0ULL;
       }
+#endif
 
       int depth() const {
           return (int)contents.depth - 2;
       }
 
+#ifdef COMPACT_HASH
+      int getValue() const {
+         return unpackScore(contents.value);
+      }
+
+      int staticValue() const {
+         return unpackScore(contents.static_value);
+      }
+
+      void setValue(int val) {
+         contents.value = packScore(val);
+      }
+#else
       int getValue() const {
          return values.value;
       }
@@ -73,6 +118,7 @@ class HashEntry {
       void setValue(int val) {
          values.value = val;
       }
+#endif
 
       ValueType type() const {
          return (ValueType)(contents.flags & TYPE_MASK);
@@ -86,6 +132,29 @@ class HashEntry {
          contents.age = age;
       }
 
+      // change the age, keeping the entry valid
+      void reAge(int age) {
+         const uint32 key = getEffectiveHash();
+         contents.age = age;
+         setKey(key);
+      }
+
+      int stale() const {
+         return (int)((contents.flags & STALE_MASK) != 0);
+      }
+
+      // mark the entry stale, keeping the entry valid
+      void markStale() {
+         const uint32 key = getEffectiveHash();
+         contents.flags |= STALE_MASK;
+         setKey(key);
+      }
+
+      // As with setAge, the key must be set again after this.
+      void clearStale() {
+         contents.flags &= ~STALE_MASK;
+      }
+
       int forced() const {
          return (int)((contents.flags & FORCED_MASK) != 0);
       }
@@ -107,11 +176,10 @@ class HashEntry {
       }
 
       Move bestMove(const Board &b) const {
-         if (contents.start == InvalidSquare)
+         if (startSquare() == InvalidSquare)
             return NullMove;
          else {
-            Move m = CreateMove(b,(Square)contents.start,(Square)contents.dest,
-               (PieceType)contents.promotion);
+            Move m = CreateMove(b,startSquare(),destSquare(),promotion());
             //if (!validMove(b,m)) return NullMove;
             if (forced()) SetForced(m);
             if (forced2()) SetForced2(m);
@@ -119,29 +187,155 @@ class HashEntry {
          }
       }
 
+      // True if the stored move is impossible in b, which shows this
+      // entry is from another position with the same key.
+      int badMove(const Board &b) const {
+         if (startSquare() == InvalidSquare)
+            return 0;
+         const Piece p = b[startSquare()];
+         if (IsEmptyPiece(p) || PieceColor(p) != b.sideToMove())
+            return 1;
+         const Piece q = b[destSquare()];
+         return !IsEmptyPiece(q) && PieceColor(q) == b.sideToMove();
+      }
+
       bool avoidNull(int null_depth, int beta) const {
           return type() == UpperBound && depth() >= null_depth &&
               getValue() < beta;
       }
 
       int operator == (const hash_t hash) const {
-         return getEffectiveHash() == hash;
+         return getEffectiveHash() == hashKey(hash);
       }
 
       int operator != (const hash_t hash) const {
-         return getEffectiveHash() != hash;
+         return getEffectiveHash() != hashKey(hash);
       }
 
-      hash_t getEffectiveHash() const {
-         return hc ^ val2 ^ val3;
+#ifdef COMPACT_HASH
+      // Only the upper 24 bits of the hash code are stored. The lower
+      // bits select the bucket and so are implied by the entry location.
+      // The low 16 bits of the key are validated against the rest of
+      // the entry, the high 8 bits are stored in the contents.
+      static uint32 hashKey(hash_t hash) {
+         return (uint32)(hash >> 40);
+      }
+
+      uint32 getEffectiveHash() const {
+         return ((uint32)contents.key2 << 16) |
+            (uint16)(hc ^ fold(val2) ^ move);
       }
 
       void setEffectiveHash(hash_t hash) {
-         hc = hash ^ val2 ^ val3;
+         setKey(hashKey(hash));
+      }
+#else
+      // Only the upper 32 bits of the hash code are stored. The lower
+      // bits select the bucket and so are implied by the entry location.
+      static uint32 hashKey(hash_t hash) {
+         return (uint32)(hash >> 32);
+      }
+
+      uint32 getEffectiveHash() const {
+         return hc ^ fold(val2) ^ fold(val3);
       }
 
+      void setEffectiveHash(hash_t hash) {
+         setKey(hashKey(hash));
+      }
+#endif
+
    protected:
 
+#ifdef COMPACT_HASH
+      // Scores are stored in 16 bits. Mate scores (and INVALID_SCORE,
+      // one past -MATE) are shifted to the ends of the 16-bit range;
+      // other scores are limited to the range below them.
+      static const int MAX_PACKED_SCORE = 32767;
+      static const int MATE_SHIFT = Constants::MATE - MAX_PACKED_SCORE;
+      static const int MAX_PACKED_EVAL = Constants::MATE_RANGE - MATE_SHIFT - 1;
+
+      // move field value for no move
+      static const uint16 NO_MOVE = 0x8000;
+
+      static int16 packScore(int score) {
+         if (score >= Constants::MATE_RANGE)
+            return (int16)(score - MATE_SHIFT);
+         else if (score <= -Constants::MATE_RANGE)
+            return (int16)(score + MATE_SHIFT);
+         else
+            return (int16)Util::Max(-MAX_PACKED_EVAL,
+                                    Util::Min(MAX_PACKED_EVAL,score));
+      }
+
+      static int unpackScore(int16 score) {
+         if (score > MAX_PACKED_EVAL)
+            return score + MATE_SHIFT;
+         else if (score < -MAX_PACKED_EVAL)
+            return score - MATE_SHIFT;
+         else
+            return score;
+      }
+
+      Square startSquare() const {
+         return (move == NO_MOVE) ? InvalidSquare : (Square)(move & 0x3f);
+      }
+
+      Square destSquare() const {
+         return (Square)((move >> 6) & 0x3f);
+      }
+
+      PieceType promotion() const {
+         return (PieceType)((move >> 12) & 0x7);
+      }
+
+      static uint16 fold(uint64 val) {
+         return (uint16)(val ^ (val >> 16) ^ (val >> 32) ^ (val >> 48));
+      }
+
+      void setKey(uint32 key) {
+         contents.key2 = (byte)(key >> 16);
+         hc = (uint16)key ^ fold(val2) ^ move;
+      }
+
+      struct Contents
+      BEGIN_PACKED_STRUCT
+        int16 value;
+        int16 static_value;
+        byte depth;
+        byte age;
+        byte flags;
+        byte key2; // high bits of the key
+      END_PACKED_STRUCT
+
+      uint16 hc;
+      uint16 move; // start, dest and promotion, or NO_MOVE
+      union
+      {
+        Contents contents;
+        uint64 val2;
+      };
+#else
+      Square startSquare() const {
+         return (Square)contents.start;
+      }
+
+      Square destSquare() const {
+         return (Square)contents.dest;
+      }
+
+      PieceType promotion() const {
+         return (PieceType)contents.promotion;
+      }
+
+      static uint32 fold(uint64 val) {
+         return (uint32)val ^ (uint32)(val >> 32);
+      }
+
+      void setKey(uint32 key) {
+         hc = key ^ fold(val2) ^ fold(val3);
+      }
+
       struct Contents
       BEGIN_PACKED_STRUCT
         int16 pad;
@@ -157,7 +351,7 @@ class HashEntry {
         int32 static_value;
       END_PACKED_STRUCT
 
-       uint64 hc;
+      uint32 hc;
       union
       {
         Contents contents;
@@ -168,6 +362,55 @@ class HashEntry {
         Values values;
         uint64 val3;
       };
+#endif
+END_PACKED_STRUCT
+
+// A group of entries sharing one hash index. Buckets are exactly one
+// cache line and the table is cache-line aligned, so a probe touches
+// only a single line of memory.
+struct HashBucket
+BEGIN_PACKED_STRUCT
+#ifdef COMPACT_HASH
+   static const int EntriesPerBucket = 5;
+#else
+   static const int EntriesPerBucket = 3;
+#endif
+   HashEntry entries[EntriesPerBucket];
+   uint32 pad; // unused, pads bucket to 64 bytes
+END_PACKED_STRUCT
+
+// Counters for hash table activity. Each search thread keeps its own
+// copy, so updates need no locking.
+struct HashStats {
+   // replacements are binned by depth of the replaced entry, in plies
+   // (bin 0 holds quiescence entries, the last bin all deeper ones)
+   static const int DEPTH_BINS = 8;
+
+   uint64 probes;
+   uint64 results[HashEntry::NoHit+1]; // probes by result (ValueType)
+   uint64 collisions; // key matched but stored move impossible
+   uint64 stores;
+   uint64 emptyFills; // stores into an empty slot
+   uint64 updates; // stores over an entry for the same position
+   // stores over another position: [0] entry from the current
+   // search, [1] entry from an older search
+   uint64 replaced[2][DEPTH_BINS];
+   // eval cache, material, pawn and king/pawn hash tables (kept by
+   // Scoring)
+   uint64 evalProbes, evalHits;
+   uint64 materialProbes, materialHits;
+   uint64 pawnProbes, pawnHits;
+   uint64 kingPawnProbes, kingPawnHits;
+
+   HashStats() {
+      clear();
+   }
+
+   void clear();
+
+   HashStats & operator += (const HashStats &);
+
+   void print(ostream &) const;
 };
 
 class Hash {
@@ -176,57 +419,85 @@ class Hash {
  public:
     Hash();
 
+    // Set whether the table is allocated with huge pages and
+    // interleaved across NUMA nodes. Takes effect at the next
+    // allocation.
+    void setMemoryOptions(int large_pages, int numa_interleave);
+
+    // allocate and clear the table
     void initHash(size_t bytes);
 
-    void resizeHash(size_t bytes);
+    // allocate the table without clearing it
+    void allocHash(size_t bytes);
+
+    // Change the table size, keeping as many of the existing entries
+    // as will fit. "age" is the current search age, used to decide
+    // which entries to keep when shrinking.
+    void resizeHash(size_t bytes, int age);
+
+    // Resizing can also be done in parallel: beginResize allocates
+    // the new table, each thread calls resizeSlice for its part of
+    // it, then resizeDone frees the old table. The old and new tables
+    // both exist until the resize is done.
+    void beginResize(size_t bytes, int age);
+
+    void resizeSlice(unsigned slice, unsigned slices);
+
+    void resizeDone();
 
     void freeHash();
 
     void clearHash();
 
-    // put info from the external permanent hash table into the
-    // in-memory hash table
-    void loadLearnInfo();
+    // Clearing can also be done in parallel: each thread calls
+    // clearSlice for its part of the table, then clearDone is called
+    // once all slices are complete.
+    void clearSlice(unsigned slice, unsigned slices);
+
+    void clearDone();
+
+    // Put info from the external permanent hash table (the learn
+    // file) into the in-memory hash table, for "board" and the
+    // positions up to LEARN_PLY plies from it.
+    void loadLearnInfo(const Board &board);
+
+    static const int LEARN_PLY = 2;
+
+    // Save the table contents to a file, or load a saved table.
+    // Loaded entries are given the specified age. Return 0 if
+    // successful, -1 if not.
+    int saveHash(const string &fileName) const;
+    int loadHash(const string &fileName, int age);
+
+    // Store an entry taken from another table with oldBuckets
+    // buckets, in which it was at index oldIndex.
+    void migrateEntry(const HashEntry &entry, size_t oldIndex,
+                      size_t oldBuckets, int age);
+
+#ifdef USE_PREFETCH
+    // Start loading the bucket for hashCode into cache, so that a
+    // later probe or store does not stall on memory.
+    void prefetch(hash_t hashCode) const {
+        PREFETCH(&hashTable[hashCode & hashMask]);
+    }
+#endif
 
     HashEntry::ValueType searchHash(const Board& b,hash_t hashCode,
                                               int ply,
                                               int depth, int age,
-                                              HashEntry &he
+                                              HashEntry &he,
+                                              HashStats *stats = NULL
                                               ) {
         if (!hashSize) return HashEntry::NoHit;
-        int probe = (int)(hashCode & hashMask);
-        HashEntry *p = &hashTable[probe];
-        HashEntry *hit = NULL;
-        for (int i = MaxRehash; i != 0; --i) {
-            // Copy hashtable entry before hash test below (avoids
-            // race where entry is validated, then changed).
-            HashEntry entry(*p);
-            if (entry == hashCode) {
-                // we got a hit on this entry in the current search,
-                // so update the age to discourage replacement:
-                if (entry.age() && (entry.age() != age)) {
-                   entry.setAge(age);
-                   entry.setEffectiveHash(hashCode);
-                   *p = entry;
-                }
-                hit = &entry;
-                he = entry;
-                if (entry.depth() >= depth) {
-                    // usable depth
-                    return he.type();
-                }
-                else {
-                    break;
-                }
-            }
-            p++;
-        }
-        if (hit) {
-          // hash hit, but with insufficient depth:
-          return HashEntry::Invalid;
-        } else {
-          return HashEntry::NoHit;
+        HashEntry::ValueType result = probe(b,hashCode,depth,age,he);
+        if (stats) {
+           stats->probes++;
+           stats->results[result]++;
+           if (result != HashEntry::NoHit && he.badMove(b)) {
+              stats->collisions++;
+           }
         }
+        return result;
     }
 
     void storeHash(hash_t hashCode, const int depth,
@@ -235,18 +506,18 @@ class Hash {
                           int value,
                           int staticValue,
                           byte flags,
-                          Move best_move) {
+                          Move best_move,
+                          HashStats *stats = NULL) {
 
         if (!hashSize) return;
-        int probe = (int)(hashCode & hashMask);
-        HashEntry *p = &hashTable[probe];
+        HashEntry *p = hashTable[hashCode & hashMask].entries;
 
         HashEntry *best = NULL;
         ASSERT(Util::Abs(value) <= Constants::MATE);
         // Of the positions that hash to the same locations
         // as this one, find the best one to replace.
         int maxScore = -Constants::MaxPly*DEPTH_INCREMENT;
-        for (int i = MaxRehash; i != 0; --i) {
+        for (int i = HashBucket::EntriesPerBucket; i != 0; --i) {
             HashEntry &q = *p;
 
             if (q.empty()) {
@@ -272,8 +543,19 @@ class Hash {
             p++;
         }
         if (best != NULL) {
-            if (best->empty()) {
-               hashFree--;
+            if (stats) {
+               stats->stores++;
+               if (best->empty()) {
+                  stats->emptyFills++;
+               }
+               else if (*best == hashCode) {
+                  stats->updates++;
+               }
+               else {
+                  const int bin = Util::Max(0,Util::Min(HashStats::DEPTH_BINS-1,
+                                                        best->depth()/DEPTH_INCREMENT));
+                  stats->replaced[best->age() != age][bin]++;
+               }
             }
             *best = HashEntry(hashCode, value, 
                               staticValue, depth, type, age, flags, best_move);
@@ -284,24 +566,93 @@ class Hash {
         return hashSize;
     }
 
-    // Percent full (percentage x 10)
-    int pctFull() const {
-        if (hashSize == 0)
-            return 0;
-        else
-            return (int)(1000.0*(hashSize-hashFree)/(double)hashSize);
-    }
+    // Percent full (percentage x 10), estimated from a sample of
+    // the table. Stale copies made by a resize are not counted.
+    int pctFull() const;
 
 private:
+    // number of buckets examined by pctFull
+    static const int OCCUPANCY_SAMPLE = 1000;
+
+    HashEntry::ValueType probe(const Board& b,hash_t hashCode,
+                               int depth, int age,
+                               HashEntry &he) {
+        HashEntry *p = hashTable[hashCode & hashMask].entries;
+        HashEntry *hit = NULL;
+        for (int i = HashBucket::EntriesPerBucket; i != 0; --i) {
+            // Copy hashtable entry before hash test below (avoids
+            // race where entry is validated, then changed).
+            HashEntry entry(*p);
+            if (entry == hashCode) {
+                // we got a hit on this entry in the current search,
+                // so update the age to discourage replacement. A
+                // stale copy that is hit is in the right bucket, so
+                // it is no longer stale.
+                if ((entry.age() && (entry.age() != age)) || entry.stale()) {
+                   if (entry.age()) entry.setAge(age);
+                   entry.clearStale();
+                   entry.setEffectiveHash(hashCode);
+                   *p = entry;
+                }
+                hit = &entry;
+                he = entry;
+                if (entry.depth() >= depth) {
+                    // usable depth
+                    return he.type();
+                }
+                else {
+                    break;
+                }
+            }
+            p++;
+        }
+        if (hit) {
+          // hash hit, but with insufficient depth:
+          return HashEntry::Invalid;
+        } else {
+          return HashEntry::NoHit;
+        }
+    }
+
+    // Stale copies rank above entries of any age, so they are
+    // replaced first.
     int replaceScore(const HashEntry &pos, int age) {
-        return (Util::Abs(pos.age()-age)<<12) - pos.depth();
+        return ((Util::Abs(pos.age()-age) + (pos.stale() ? 256 : 0))<<12) -
+           pos.depth();
     }
 
-    HashEntry *hashTable;
-    size_t hashSize, hashFree;
+    // When the table grows from oldBuckets buckets, an entry from old
+    // bucket index % oldBuckets is copied to each new bucket it could
+    // belong in. One copy, chosen by low bits of the stored key so
+    // copies are spread evenly, is kept as is; the rest are marked
+    // stale. Returns the copy to store in new bucket "index".
+    static HashEntry growCopy(const HashEntry &entry, size_t index,
+                              size_t oldBuckets, size_t buckets) {
+        HashEntry copy(entry);
+        const size_t ratio = buckets/oldBuckets;
+        if ((entry.getEffectiveHash() & (ratio-1)) != index/oldBuckets) {
+            copy.markStale();
+        }
+        return copy;
+    }
+
+    void insertEntry(HashBucket &bucket, const HashEntry &entry, int age);
+
+    static void freeTable(HashBucket *table, size_t buckets, int mapped);
+
+    HashBucket *hashTable;
+    // hashSize counts entries, not buckets
+    size_t hashSize;
     hash_t hashMask;
-    static const int MaxRehash = 4;
     int hash_init_done;
+    int mapped; // table allocated with mmap
+    int untouched; // table not yet cleared after allocation
+    // table being copied from during a resize
+    HashBucket *oldTable;
+    size_t oldBuckets;
+    int oldMapped;
+    int resizeAge;
+    int largePages, numaInterleave;
 };
 
 #endif
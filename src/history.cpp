@@ -3,8 +3,6 @@
 #include "history.h"
 #include "search.h"
 
-struct History::HistoryEntry History::history[16][64];
-
 void History::clearHistory() {
   for (int i = 0; i < 16; i++) {
     for (int j = 0; j < 64; j++) {
@@ -8,29 +8,35 @@
 struct NodeInfo;
 class Board;
 
+// History table. Each Search instance has its own copy (part of its
+// SearchContext), so threads do not contend for it.
 class History {
 
 public:
-    static void clearHistory();
+    History() {
+       clearHistory();
+    }
+
+    void clearHistory();
 
-    static int scoreForOrdering (Move m, ColorType side) {
+    int scoreForOrdering (Move m, ColorType side) const {
        return history[MakePiece(PieceMoved(m),side)][DestSquare(m)].order;
     }
 
-    static int scoreForPruning (Move m, ColorType side) {
+    int scoreForPruning (Move m, ColorType side) const {
       const HistoryEntry &h = history[MakePiece(PieceMoved(m),side)][DestSquare(m)];
       if (h.total == 0) return Constants::HISTORY_MAX;
       else return h.successCount*Constants::HISTORY_MAX/h.total;
     }
 
-    static void updateHistory(const Board &,
+    void updateHistory(const Board &,
        NodeInfo *parentNode, Move best, int depth, ColorType side);
 
-    static void updateHistoryMove(const Board &,
+    void updateHistoryMove(const Board &,
        Move best, int depth, ColorType side);
 
  private:
-    static struct CACHE_ALIGN HistoryEntry {
+    struct HistoryEntry {
       int successCount, failureCount, order, total;
     } history[16][64];
 };
@@ -5,10 +5,408 @@
 #include "util.h"
 #include "scoring.h"
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+extern "C" {
+#include <memory.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+};
 
 // max ply for position learning
 #define POSITION_MAX_PLY 60
 
+// text format file from previous versions
+static const char * TEXT_LEARN_FILE_NAME = "arasan.lrn";
+
+struct LearnFileHeader {
+   char magic[8];
+   uint32 version;
+   uint32 byteOrder;
+   uint64 sorted; // count of records in the sorted section
+   char pad[8];
+};
+
+struct LearnFileRecord
+BEGIN_PACKED_STRUCT
+  uint64 hashcode;
+  int32 score;
+  byte depth;
+  byte flags; // in check flag (bit 0), promotion (bits 1-3)
+  signed char start, dest;
+END_PACKED_STRUCT
+
+static const char LEARN_FILE_MAGIC[8] = {'A','r','a','s','a','n','L','R'};
+static const uint32 LEARN_FILE_VERSION = 1;
+static const uint32 LEARN_FILE_BYTE_ORDER = 0x01020304;
+
+// queued records not yet written, and its lock
+static vector<LearnRecord> pending;
+static LockDefine(pending_lock);
+
+// held while the learn file is read, converted or rewritten
+static LockDefine(learn_file_lock);
+
+// the file as mapped for lookups, and its size and modification time
+// at that point (protected by learn_file_lock)
+static LearnFile *sharedFile = NULL;
+static off_t sharedFileSize;
+static time_t sharedFileTime;
+
+// background writer started by flushLearnRecordsInBackground
+#ifdef _WIN32
+static HANDLE writerThread = NULL;
+#else
+static pthread_t writerThread;
+static bool writerRunning = false;
+#endif
+
+static void waitForLearnWriter();
+
+void initLearning() {
+   LockInit(pending_lock);
+   LockInit(learn_file_lock);
+}
+
+void cleanupLearning() {
+   waitForLearnWriter();
+   delete sharedFile;
+   sharedFile = NULL;
+   LockDestroy(pending_lock);
+   LockDestroy(learn_file_lock);
+}
+
+static void pack(const LearnRecord &rec, LearnFileRecord &out) {
+   out.hashcode = rec.hashcode;
+   out.score = rec.score;
+   out.depth = (byte)Util::Min(rec.depth,255);
+   out.flags = (byte)((rec.in_check ? 1 : 0) | ((int)rec.promotion << 1));
+   out.start = (signed char)rec.start;
+   out.dest = (signed char)rec.dest;
+}
+
+static void unpack(const LearnFileRecord &in, LearnRecord &rec) {
+   rec.hashcode = in.hashcode;
+   rec.score = in.score;
+   rec.depth = in.depth;
+   rec.in_check = in.flags & 1;
+   rec.promotion = (PieceType)((in.flags >> 1) & 7);
+   rec.start = in.start;
+   rec.dest = in.dest;
+}
+
+static bool compareRecords(const LearnFileRecord &a, const LearnFileRecord &b) {
+   return a.hashcode < b.hashcode;
+}
+
+// Write a complete file from a set of records. The records are
+// sorted, and if there are duplicates the last one is kept.
+static int writeLearnFile(const string &fileName,
+                          vector<LearnFileRecord> &records) {
+   stable_sort(records.begin(),records.end(),compareRecords);
+   vector<LearnFileRecord> unique;
+   for (size_t i = 0; i < records.size(); i++) {
+      if (i+1 < records.size() &&
+          records[i+1].hashcode == records[i].hashcode) continue;
+      unique.push_back(records[i]);
+   }
+   LearnFileHeader header;
+   memset(&header,'\0',sizeof(LearnFileHeader));
+   memcpy(header.magic,LEARN_FILE_MAGIC,sizeof(header.magic));
+   header.version = LEARN_FILE_VERSION;
+   header.byteOrder = LEARN_FILE_BYTE_ORDER;
+   header.sorted = unique.size();
+   // write a temp file, then replace the old file with it
+   const string tmpName = fileName + ".tmp";
+   ofstream out(tmpName.c_str(), ios::out | ios::trunc | ios::binary);
+   out.write((const char*)&header,sizeof(LearnFileHeader));
+   if (unique.size()) {
+      out.write((const char*)&unique[0],unique.size()*sizeof(LearnFileRecord));
+   }
+   out.close();
+   if (out.fail()) {
+      remove(tmpName.c_str());
+      return -1;
+   }
+#ifdef _WIN32
+   remove(fileName.c_str());
+#endif
+   return rename(tmpName.c_str(),fileName.c_str()) ? -1 : 0;
+}
+
+// Convert a text learn file from a previous version
+static void convertTextLearnFile(const string &textName,
+                                 const string &fileName) {
+   ifstream in(textName.c_str(),ios_base::in);
+   if (!in.good()) return;
+   vector<LearnFileRecord> records;
+   while (in.good() && !in.eof()) {
+      LearnRecord rec;
+      if (getLearnRecord(in,rec)) {
+         LearnFileRecord out;
+         pack(rec,out);
+         records.push_back(out);
+      }
+   }
+   if (writeLearnFile(fileName,records)) {
+      cerr << "error converting learn file " << textName << endl;
+   }
+}
+
+static int validHeader(const LearnFileHeader &header, size_t count) {
+   return memcmp(header.magic,LEARN_FILE_MAGIC,sizeof(header.magic)) == 0 &&
+      header.version == LEARN_FILE_VERSION &&
+      header.byteOrder == LEARN_FILE_BYTE_ORDER &&
+      header.sorted <= count;
+}
+
+LearnFile::LearnFile(const string &fileName, bool lock)
+   : data(NULL), dataSize(0), count(0), sorted(0)
+{
+   if (lock) Lock(learn_file_lock);
+   open(fileName);
+   if (lock) Unlock(learn_file_lock);
+}
+
+void LearnFile::open(const string &fileName)
+{
+   ifstream test(fileName.c_str(),ios_base::in | ios_base::binary);
+   if (!test.good()) {
+      convertTextLearnFile(derivePath(TEXT_LEARN_FILE_NAME),fileName);
+   }
+   test.close();
+#ifdef _WIN32
+   ifstream in(fileName.c_str(),ios_base::in | ios_base::binary);
+   if (!in.good()) return;
+   in.seekg(0,ios_base::end);
+   dataSize = (size_t)in.tellg();
+   in.seekg(0,ios_base::beg);
+   if (dataSize < sizeof(LearnFileHeader)) return;
+   buf.resize(dataSize);
+   in.read((char*)&buf[0],dataSize);
+   if (in.fail()) return;
+   data = &buf[0];
+#else
+   int fd = ::open(fileName.c_str(),O_RDONLY);
+   if (fd == -1) return;
+   struct stat st;
+   if (fstat(fd,&st) == 0 && (size_t)st.st_size >= sizeof(LearnFileHeader)) {
+      void *p = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+      if (p != MAP_FAILED) {
+         data = (const byte*)p;
+         dataSize = (size_t)st.st_size;
+      }
+   }
+   close(fd);
+   if (data == NULL) return;
+#endif
+   count = (dataSize-sizeof(LearnFileHeader))/sizeof(LearnFileRecord);
+   const LearnFileHeader *header = (const LearnFileHeader*)data;
+   if (validHeader(*header,count)) {
+      sorted = (size_t)header->sorted;
+   } else {
+      cerr << "invalid learn file " << fileName << endl;
+      count = 0;
+   }
+   // The appended section is bounded in size (see flushLearnRecords)
+   // but is not in order, so index it.
+   const LearnFileRecord *records =
+      (const LearnFileRecord*)(data+sizeof(LearnFileHeader));
+   vector< pair<uint64,size_t> > keys;
+   for (size_t i = sorted; i < count; i++) {
+      keys.push_back(pair<uint64,size_t>(records[i].hashcode,i));
+   }
+   // equal hash codes stay in file order, so the latest is last
+   std::sort(keys.begin(),keys.end());
+   for (size_t i = 0; i < keys.size(); i++) {
+      appended.push_back(keys[i].second);
+   }
+}
+
+LearnFile::~LearnFile() {
+#ifndef _WIN32
+   if (data) munmap((void*)data,dataSize);
+#endif
+}
+
+void LearnFile::get(size_t i, LearnRecord &rec) const {
+   ASSERT(i < count);
+   const LearnFileRecord *records =
+      (const LearnFileRecord*)(data+sizeof(LearnFileHeader));
+   unpack(records[i],rec);
+}
+
+int LearnFile::find(hash_t hashcode, LearnRecord &rec) const {
+   const LearnFileRecord *records =
+      (const LearnFileRecord*)(data+sizeof(LearnFileHeader));
+   // appended records are newer, so check them first
+   size_t lo = 0, hi = appended.size();
+   while (lo < hi) {
+      const size_t mid = (lo+hi)/2;
+      if (records[appended[mid]].hashcode <= hashcode) lo = mid+1;
+      else hi = mid;
+   }
+   if (lo > 0 && records[appended[lo-1]].hashcode == hashcode) {
+      unpack(records[appended[lo-1]],rec);
+      return 1;
+   }
+   // the sorted section has no duplicates
+   lo = 0; hi = sorted;
+   while (lo < hi) {
+      const size_t mid = (lo+hi)/2;
+      if (records[mid].hashcode < hashcode) lo = mid+1;
+      else hi = mid;
+   }
+   if (lo < sorted && records[lo].hashcode == hashcode) {
+      unpack(records[lo],rec);
+      return 1;
+   }
+   return 0;
+}
+
+void findLearnRecords(const vector<hash_t> &hashcodes,
+                      vector<LearnRecord> &records) {
+   Lock(learn_file_lock);
+   struct stat st;
+   const int exists = stat(learnFileName.c_str(),&st) == 0;
+   if (sharedFile == NULL || !exists || st.st_size != sharedFileSize ||
+       st.st_mtime != sharedFileTime) {
+      delete sharedFile;
+      sharedFile = new LearnFile(learnFileName,false);
+      // the file may have been created by converting a text file
+      if (stat(learnFileName.c_str(),&st) == 0) {
+         sharedFileSize = st.st_size;
+         sharedFileTime = st.st_mtime;
+      }
+   }
+   for (size_t i = 0; i < hashcodes.size(); i++) {
+      LearnRecord rec;
+      if (sharedFile->find(hashcodes[i],rec)) {
+         records.push_back(rec);
+      }
+   }
+   Unlock(learn_file_lock);
+}
+
+void addLearnRecord(const LearnRecord &rec) {
+   Lock(pending_lock);
+   pending.push_back(rec);
+   Unlock(pending_lock);
+}
+
+void flushLearnRecords() {
+   vector<LearnRecord> batch;
+   Lock(pending_lock);
+   batch.swap(pending);
+   Unlock(pending_lock);
+   if (batch.size() == 0) return;
+   // Reading the old contents and writing the new file is done under
+   // one lock, so concurrent flushes do not lose each other's records.
+   Lock(learn_file_lock);
+   LearnFile *file = new LearnFile(learnFileName,false);
+   const size_t unsorted = file->size() - file->sortedSize() + batch.size();
+   if (file->size() == 0 ||
+       unsorted > std::max<size_t>(file->sortedSize()/4,1024)) {
+      // (Re)write the whole file in sorted order.
+      vector<LearnFileRecord> records;
+      for (size_t i = 0; i < file->size(); i++) {
+         LearnRecord rec;
+         file->get(i,rec);
+         LearnFileRecord out;
+         pack(rec,out);
+         records.push_back(out);
+      }
+      delete file;
+      file = NULL;
+      for (size_t i = 0; i < batch.size(); i++) {
+         LearnFileRecord out;
+         pack(batch[i],out);
+         records.push_back(out);
+      }
+      if (writeLearnFile(learnFileName,records)) {
+         cerr << "error writing learn file " << learnFileName << endl;
+      }
+   } else {
+      delete file;
+      file = NULL;
+      // append to the unsorted section
+      ofstream out(learnFileName.c_str(),
+                   ios_base::out | ios_base::app | ios_base::binary);
+      for (size_t i = 0; i < batch.size(); i++) {
+         LearnFileRecord rec;
+         pack(batch[i],rec);
+         out.write((const char*)&rec,sizeof(LearnFileRecord));
+      }
+      out.close();
+      if (out.fail()) {
+         cerr << "error writing learn file " << learnFileName << endl;
+      }
+   }
+   // map the new contents at the next lookup (the size and time
+   // may not show the change)
+   delete sharedFile;
+   sharedFile = NULL;
+   Unlock(learn_file_lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI learnWriter(void *) {
+   flushLearnRecords();
+   return 0;
+}
+#else
+static void *learnWriter(void *) {
+   flushLearnRecords();
+   return NULL;
+}
+#endif
+
+static void waitForLearnWriter() {
+#ifdef _WIN32
+   if (writerThread != NULL) {
+      WaitForSingleObject(writerThread,INFINITE);
+      CloseHandle(writerThread);
+      writerThread = NULL;
+   }
+#else
+   if (writerRunning) {
+      pthread_join(writerThread,NULL);
+      writerRunning = false;
+   }
+#endif
+}
+
+void flushLearnRecordsInBackground() {
+   waitForLearnWriter();
+   Lock(pending_lock);
+   const bool empty = pending.empty();
+   Unlock(pending_lock);
+   if (empty) return;
+#ifdef _WIN32
+   DWORD id;
+   writerThread = CreateThread(NULL,0,learnWriter,NULL,0,&id);
+   if (writerThread == NULL) {
+      flushLearnRecords();
+   }
+#else
+   if (pthread_create(&writerThread,NULL,learnWriter,NULL)) {
+      perror("learn writer thread creation failed");
+      flushLearnRecords();
+   } else {
+      writerRunning = true;
+   }
+#endif
+}
+
 void learn(const Board &board, int rep_count)
 {
    // Do position learning. If our score has dropped or
@@ -43,17 +441,17 @@ void learn(const Board &board, int rep_count)
          if (last_depth > options.learning.position_learning_minDepth &&
             (diff1 > score_threshold || diff2 > score_threshold)) {
             // last 2 or more moves were not from book, and score has changed
-            // significantly. Append to the learn file.
-            stringstream s;
-            s << (hex) << board.hashCode(rep_count);
-            s << ' ' << (dec) << (board.checkStatus() == InCheck) << 
-                 ' ' << last_score << ' ' << last_depth << ' ';
-            MoveImage(last_entry.move(),s);
-            s << '\n';
-            ofstream log;
-            log.open(learnFileName.c_str(),ios_base::out | ios_base::app);
-            log << s.str();
-            log.close();
+            // significantly. Queue a record for the learn file.
+            LearnRecord rec;
+            rec.hashcode = board.hashCode(rep_count);
+            rec.in_check = (board.checkStatus() == InCheck);
+            rec.score = last_score;
+            rec.depth = last_depth;
+            const Move move = last_entry.move();
+            rec.start = StartSquare(move);
+            rec.dest = DestSquare(move);
+            rec.promotion = PromoteTo(move);
+            addLearnRecord(rec);
             stringstream str;
             str << "learning position, score = ";
             Scoring::printScore(last_score,str);
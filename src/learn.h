@@ -8,6 +8,7 @@
 #include "board.h"
 #include "log.h"
 #include <istream>
+#include <vector>
 
 // Activate the book learning feature. Call after a move
 // has been added to the log. Board is the position before the move.
@@ -21,7 +22,77 @@ struct LearnRecord {
   PieceType promotion;
 };
 
-// Retrieve position learning info
+// Retrieve position learning info from a text format file
 extern int getLearnRecord(istream &learnFile, LearnRecord &);
 
+// Set up and free the locks used by the functions below. Called
+// from initGlobals and cleanupGlobals.
+extern void initLearning();
+
+extern void cleanupLearning();
+
+// Binary position learning file. It contains a section sorted by
+// hash code, followed by any records appended since the file was
+// last sorted. The file is memory-mapped where supported. If it does
+// not exist but an old text format learn file does, the text file is
+// converted.
+class LearnFile {
+ public:
+    // The file is opened holding the learn file lock, so it is not
+    // read while being converted or rewritten. "lock" is false only
+    // when the caller already holds it.
+    LearnFile(const string &fileName, bool lock = true);
+
+    ~LearnFile();
+
+    // number of records
+    size_t size() const {
+       return count;
+    }
+
+    // number of records in the sorted section
+    size_t sortedSize() const {
+       return sorted;
+    }
+
+    // get the i'th record, in file order
+    void get(size_t i, LearnRecord &rec) const;
+
+    // Find the record for a position, by binary search. If a position
+    // has more than one record, the latest is returned. Returns 1 if
+    // found, 0 if not.
+    int find(hash_t hashcode, LearnRecord &rec) const;
+
+ private:
+    void open(const string &fileName);
+
+    const byte *data;
+    size_t dataSize, count, sorted;
+    // indexes of the appended records, sorted by hash code
+    vector<size_t> appended;
+#ifdef _WIN32
+    vector<byte> buf;
+#endif
+};
+
+// Queue a record for appending to the binary learn file. Records
+// are written in batches by flushLearnRecords. The queue is shared
+// by all searchers in the process and is locked.
+extern void addLearnRecord(const LearnRecord &rec);
+
+// Write queued learn records, re-sorting the file if the appended
+// section has grown large. Concurrent calls are serialized.
+extern void flushLearnRecords();
+
+// Call flushLearnRecords in a separate thread. Waits for any
+// previous background write to finish first. Should be called from
+// one thread only.
+extern void flushLearnRecordsInBackground();
+
+// Look up the learn file records for a set of positions, appending
+// any found to "records". The file is mapped once and shared by all
+// callers; it is mapped again only if it has changed.
+extern void findLearnRecords(const vector<hash_t> &hashcodes,
+                             vector<LearnRecord> &records);
+
 #endif
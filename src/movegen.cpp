@@ -106,11 +106,20 @@ int trace)
 }
 
 
-int RootMoveGenerator::generateAllMoves(NodeInfo *, SplitPoint *)
+int RootMoveGenerator::generateAllMoves(NodeInfo *, SplitPoint *split)
 {
-   // There's nothing to be done here since we generated moves in the
-   // constructor. Just return the number of moves remaining.
-   return batch_count-index;
+   // The moves were generated in the constructor, so just copy the
+   // remaining ones to the split point.
+   int count = 0;
+   split->orderBase = order;
+   for (int i = index; i < batch_count; i++) {
+      split->moves[count++] = moveList[i].move;
+   }
+   split->moveCount = count;
+   split->moveIndex = 0;
+   order += count;
+   index = batch_count;
+   return count;
 }
 
 static bool compareScores(const MoveEntry &a, const MoveEntry &b) {
@@ -150,7 +159,7 @@ void RootMoveGenerator::reorder(Move pvMove,int depth,bool initial)
           SetPhase(moveList[i].move,HISTORY_PHASE);
           if (initial) {
              moveList[i].score = context ? 
-                History::scoreForOrdering(moveList[i].move,board.sideToMove())
+                context->history.scoreForOrdering(moveList[i].move,board.sideToMove())
                 : 0;
           }
       }
@@ -407,7 +416,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          {
             numMoves = generateNonCaptures(moves);
             if (numMoves) {
-               Move ref = Refutations::getRefutation(prevMove);
+               Move ref = context ? context->refutations.getRefutation(prevMove) : NullMove;
                int scores[Constants::MaxMoves];
                for (int i = 0; i < numMoves; i++) {
                   scores[i] = 0;
@@ -427,7 +436,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
                   }
                   SetPhase(moves[i],HISTORY_PHASE);
                   if (context) {
-                      scores[i] = History::scoreForOrdering(moves[i],board.sideToMove());
+                      scores[i] = context->history.scoreForOrdering(moves[i],board.sideToMove());
                   }
                   if (MovesEqual(ref,moves[i])) {
                      // score refutation much higher
@@ -1269,15 +1278,12 @@ int MoveGenerator::generateAllMoves(NodeInfo *node, SplitPoint *split)
          split->moves[count++] = m;
       }
    }
-   // restore order to what it was before movegen. The next
-   // move fetched via getMove or getEvasion will have this
-   // order.
-   order = temp;
-   batch_count = count;
-   // technically this is volatile but we are accessing it here
-   // pre-split:
-   batch = (Move *)split->moves;
-   index = 0;
+   // Moves are now handed out by the split point, starting with
+   // the order the next move would have had.
+   split->orderBase = temp;
+   split->moveCount = count;
+   split->moveIndex = 0;
+   batch_count = index = 0;
    phase = LAST_PHASE;
    return count;
 }
@@ -1317,30 +1323,6 @@ int MoveGenerator::generateAllMoves(Move *moves,int repeatable)
 }
 
 
-Move MoveGenerator:: nextMove(SplitPoint *s,int &order)
-{
-   if (s) {
-      s->lock();
-      Move m = nextMove(order);
-      s->unlock();
-      return m;
-   }
-   else
-      return nextMove(order);
-}
-
-
-Move MoveGenerator::nextEvasion(SplitPoint *s,int &ord)
-{
-   if (s) {
-      s->lock();
-      Move m = nextEvasion(ord);
-      s->unlock();
-      return m;
-   }
-   else
-      return nextEvasion(ord);
-}
 
 uint64 RootMoveGenerator::perft(Board &b, int depth) {
    if (depth == 0) return 1;
@@ -79,9 +79,6 @@ class MoveGenerator
       // Generate the next check evasion, NullMove if none left
       virtual Move nextEvasion(int &order);
 
-      virtual Move nextMove(SplitPoint *,int &order);
-      virtual Move nextEvasion(SplitPoint *, int &order);
-
       virtual int generateAllMoves(NodeInfo *, SplitPoint *);
 
       // Generate only non-capturing moves.
@@ -216,8 +213,6 @@ class RootMoveGenerator : public MoveGenerator
          return nextMove(order);
       }
 
-      using MoveGenerator::nextMove;
-      using MoveGenerator::nextEvasion;
       virtual int generateAllMoves(NodeInfo *, SplitPoint *);
 
       void reorder(Move pvMove, int depth, bool initial = false);
@@ -17,10 +17,21 @@ using namespace std;
 
 const string Options::NALIMOV_TYPE = "Nalimov";
 const string Options::GAVIOTA_TYPE = "Gaviota";
+const string Options::AFFINITY_NONE = "none";
+const string Options::AFFINITY_SEQUENTIAL = "sequential";
+const string Options::AFFINITY_COMPACT = "compact";
+const string Options::AFFINITY_SCATTER = "scatter";
 
 Options::SearchOptions::SearchOptions() : 
       checks_in_qsearch(1),
       hash_table_size(32*1024*1024),
+#ifdef TUNE
+      pawn_hash_size(1024*1024),
+#else
+      pawn_hash_size(2*1024*1024),
+#endif
+      large_pages(0),
+      numa_interleave(0),
       can_resign(1),
       resign_threshold(-500),
 #if defined(NALIMOV_TBS) || defined(GAVIOTA_TBS)
@@ -38,6 +49,9 @@ Options::SearchOptions::SearchOptions() :
       strength(100),
       multipv(1),
       ncpus(1),
+      lazy_smp(0),
+      thread_affinity("none"),
+      spin_wait(50),
       easy_plies(3),
       easy_threshold(2000) {
 #if defined(GAVIOTA_TBS)
@@ -48,6 +62,11 @@ Options::SearchOptions::SearchOptions() :
 }
 
 
+int Options::validAffinity(const string &policy) {
+    return policy == AFFINITY_NONE || policy == AFFINITY_SEQUENTIAL ||
+        policy == AFFINITY_COMPACT || policy == AFFINITY_SCATTER;
+}
+
 template <class T>
 void Options::setOption(const string &name,
                         const string &valueString, T &value) {
@@ -147,6 +166,15 @@ void Options::set_option(const string &name, const string &value) {
   else if (name == "search.hash_table_size") {
     setMemoryOption(search.hash_table_size,value);
   }
+  else if (name == "search.pawn_hash_size") {
+    setMemoryOption(search.pawn_hash_size,value);
+  }
+  else if (name == "search.large_pages") {
+    set_boolean_option(name,value,search.large_pages);
+  }
+  else if (name == "search.numa_interleave") {
+    set_boolean_option(name,value,search.numa_interleave);
+  }
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS)
   else if (name == "search.use_tablebases") {
     set_boolean_option(name,value,search.use_tablebases);
@@ -195,6 +223,19 @@ void Options::set_option(const string &name, const string &value) {
   else if (name == "search.ncpus") {
     setOption<int>(name,value,search.ncpus);
   }
+  else if (name == "search.lazy_smp") {
+    set_boolean_option(name,value,search.lazy_smp);
+  }
+  else if (name == "search.thread_affinity") {
+    if (validAffinity(value)) {
+      search.thread_affinity = value;
+    } else {
+      cerr << "warning: invalid value for option " << name << endl;
+    }
+  }
+  else if (name == "search.spin_wait") {
+    setOption<int>(name,value,search.spin_wait);
+  }
   else
     cerr << "warning: unrecognized option name: " << name << endl;
 }
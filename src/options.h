@@ -14,6 +14,15 @@ class Options
     static const string NALIMOV_TYPE;
     static const string GAVIOTA_TYPE;
 
+    // thread affinity policies
+    static const string AFFINITY_NONE;
+    static const string AFFINITY_SEQUENTIAL;
+    static const string AFFINITY_COMPACT;
+    static const string AFFINITY_SCATTER;
+
+    // return 1 if the string names a thread affinity policy
+    static int validAffinity(const string &policy);
+
   struct BookOptions {
     BookOptions() 
       : selectivity(50),
@@ -31,6 +40,9 @@ class Options
 
    int checks_in_qsearch;
    size_t hash_table_size;
+   size_t pawn_hash_size; // per search thread
+   int large_pages; // use huge pages for the hash table
+   int numa_interleave; // spread hash table across NUMA nodes
    int can_resign;
    int resign_threshold;
 #if defined(NALIMOV_TBS) || defined(GAVIOTA_TBS)
@@ -49,6 +61,9 @@ class Options
    int strength; // 0 .. 100
    int multipv; // for UCI only
    int ncpus;
+   int lazy_smp; // threads search independently, sharing the hash table
+   string thread_affinity; // policy for pinning search threads to CPUs
+   int spin_wait; // time idle threads spin before blocking (microseconds)
 #ifdef SELFPLAY
    int mod;
 #endif
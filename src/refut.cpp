@@ -1,7 +1,3 @@
 // Copyright 2015 by Jon Dart. All Rights Reserved.
 
 #include "refut.h"
-
-Move Refutations::refutations[REFUTATION_TABLE_SIZE];
-
-
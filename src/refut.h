@@ -5,19 +5,25 @@
 
 #include "chess.h"
 
+// Refutation (countermove) table. Like the history table, there is
+// one per Search instance.
 class Refutations {
  public:
 
-    static Move getRefutation(Move prev) {
+    Refutations() {
+      clearRefutations();
+    }
+
+    Move getRefutation(Move prev) const {
       return refutations[refutationKey(prev)];
     }
-    static void setRefutation(Move prev, Move ref) {
+    void setRefutation(Move prev, Move ref) {
       if (!IsNull(prev) && !CaptureOrPromotion(ref)) {
         refutations[refutationKey(prev)] = ref;
       }
     }
 
-    static void clearRefutations() {
+    void clearRefutations() {
       for (int i = 0; i < REFUTATION_TABLE_SIZE; i++) refutations[i] = NullMove;
     }
 
@@ -31,7 +37,7 @@ class Refutations {
       return key;
     }
 
-    static Move refutations[REFUTATION_TABLE_SIZE];
+    Move refutations[REFUTATION_TABLE_SIZE];
 };
 
 
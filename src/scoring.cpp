@@ -81,6 +81,8 @@ struct BishopTrapPattern
 
 static const int BITBASE_WIN = 50000;
 
+const int Scoring::LAZY_MARGIN = int(2.5*PAWN_VALUE);
+
 static Bitboard backwardW[64], backwardB[64];
 CACHE_ALIGN Bitboard passedW[64], passedB[64];              // not static because needed by search module
 static Bitboard outpostW[64], outpostB[64];
@@ -343,16 +345,152 @@ void Scoring::init() {
 #ifdef TUNE
    tune_params.applyParams();
 #endif
+   initPstTable();
+}
+
+void Scoring::initPstTable() {
+   memset(Board::pstTable,'\0',sizeof(Board::pstTable));
+   for (int i = 0; i < 64; i++) {
+      for (int c = 0; c < 2; c++) {
+         const ColorType side = (ColorType)c;
+         // Black scores use the square reflected through the center
+         const Square scoreSq = (side == White) ? i : 63 - i;
+         PstScores *pst = Board::pstTable[MakePiece(Knight,side)];
+         pst[i].mid = PARAM(KNIGHT_PST)[Midgame][scoreSq];
+         pst[i].end = PARAM(KNIGHT_PST)[Endgame][scoreSq];
+         pst = Board::pstTable[MakePiece(Bishop,side)];
+         pst[i].mid = PARAM(BISHOP_PST)[Midgame][scoreSq];
+         pst[i].end = PARAM(BISHOP_PST)[Endgame][scoreSq];
+         pst = Board::pstTable[MakePiece(Rook,side)];
+         pst[i].mid = PARAM(ROOK_PST)[Midgame][scoreSq];
+         pst[i].end = PARAM(ROOK_PST)[Endgame][scoreSq];
+         pst = Board::pstTable[MakePiece(Queen,side)];
+         pst[i].mid = PARAM(QUEEN_PST)[Midgame][scoreSq];
+         pst[i].end = PARAM(QUEEN_PST)[Endgame][scoreSq];
+         // The endgame King PST is part of the (scaled) king position
+         // score computed in calcKingEndgamePosition, so only the
+         // midgame value is included here.
+         pst = Board::pstTable[MakePiece(King,side)];
+         pst[i].mid = PARAM(KING_PST)[Midgame][scoreSq];
+      }
+   }
+}
+
+void Scoring::calcPstScores(const Board &board, ColorType side, PstScores &pst) {
+   pst.mid = pst.end = 0;
+   Bitboard b(board.occupied[side] & ~board.pawn_bits[side]);
+   Square sq;
+   while (b.iterate(sq)) {
+      const Square scoreSq = (side == White) ? sq : 63 - sq;
+      switch(TypeOfPiece(board[sq])) {
+      case Knight:
+         pst.mid += PARAM(KNIGHT_PST)[Midgame][scoreSq];
+         pst.end += PARAM(KNIGHT_PST)[Endgame][scoreSq];
+         break;
+      case Bishop:
+         pst.mid += PARAM(BISHOP_PST)[Midgame][scoreSq];
+         pst.end += PARAM(BISHOP_PST)[Endgame][scoreSq];
+         break;
+      case Rook:
+         pst.mid += PARAM(ROOK_PST)[Midgame][scoreSq];
+         pst.end += PARAM(ROOK_PST)[Endgame][scoreSq];
+         break;
+      case Queen:
+         pst.mid += PARAM(QUEEN_PST)[Midgame][scoreSq];
+         pst.end += PARAM(QUEEN_PST)[Endgame][scoreSq];
+         break;
+      case King:
+         pst.mid += PARAM(KING_PST)[Midgame][scoreSq];
+         break;
+      default:
+         break;
+      }
+   }
 }
 
 void Scoring::cleanup() {
 }
 
-Scoring::Scoring() {
-   clearHashTables();
+Scoring::Scoring(const Options::SearchOptions &opts)
+   : pawnHashTable(NULL),pawnHashMask(0),evalCache(NULL),
+     materialHashTable(NULL),kingPawnHashMask(0),
+     strength(opts.strength) {
+   kingPawnHashTable[White] = kingPawnHashTable[Black] = NULL;
+   ALIGNED_MALLOC(evalCache,uint64,sizeof(uint64)*EVAL_CACHE_SIZE,128);
+   ALIGNED_MALLOC(materialHashTable,MaterialHashEntry,
+                  sizeof(MaterialHashEntry)*MATERIAL_HASH_SIZE,128);
+   if (evalCache == NULL || materialHashTable == NULL) {
+      cerr << "eval cache allocation failed!" << endl;
+      exit(-1);
+   }
+   clearEvalCache();
+   clearCacheStats();
+   setPawnHashSize(opts.pawn_hash_size);
 }
 
 Scoring::~Scoring() {
+   freePawnHash();
+   if (evalCache) ALIGNED_FREE(evalCache);
+   if (materialHashTable) ALIGNED_FREE(materialHashTable);
+}
+
+void Scoring::freePawnHash() {
+   if (pawnHashTable) ALIGNED_FREE(pawnHashTable);
+   for (int side = 0; side < 2; side++) {
+      if (kingPawnHashTable[side]) ALIGNED_FREE(kingPawnHashTable[side]);
+      kingPawnHashTable[side] = NULL;
+   }
+   pawnHashTable = NULL;
+}
+
+void Scoring::setPawnHashSize(size_t bytes) {
+   // largest power of 2 number of entries that fits, with a minimum
+   // of 1K entries
+   size_t entries = 1024;
+   while (entries*2*sizeof(PawnHashEntry) <= bytes) entries *= 2;
+   if (pawnHashTable && pawnHashMask == entries-1) {
+      return; // no change
+   }
+   for (;;) {
+      // The two king/pawn tables together have as many entries as the
+      // pawn table (the pawn hash is probed once per eval, the king/pawn
+      // hash once per side).
+      const size_t kpEntries = entries/2;
+      PawnHashEntry *pawnTable;
+      KingPawnHashEntry *kpTable[2];
+      ALIGNED_MALLOC(pawnTable,PawnHashEntry,
+                     sizeof(PawnHashEntry)*entries,128);
+      for (int side = 0; side < 2; side++) {
+         ALIGNED_MALLOC(kpTable[side],KingPawnHashEntry,
+                        sizeof(KingPawnHashEntry)*kpEntries,128);
+      }
+      if (pawnTable && kpTable[White] && kpTable[Black]) {
+         freePawnHash();
+         pawnHashTable = pawnTable;
+         kingPawnHashTable[White] = kpTable[White];
+         kingPawnHashTable[Black] = kpTable[Black];
+         pawnHashMask = (hash_t)(entries-1);
+         kingPawnHashMask = (hash_t)(kpEntries-1);
+         clearHashTables();
+         return;
+      }
+      if (pawnTable) ALIGNED_FREE(pawnTable);
+      for (int side = 0; side < 2; side++) {
+         if (kpTable[side]) ALIGNED_FREE(kpTable[side]);
+      }
+      if (pawnHashTable) {
+         // keep the tables we have
+         cerr << "pawn hash table allocation failed, size not changed" << endl;
+         return;
+      }
+      if (entries == 1024) {
+         cerr << "pawn hash table allocation failed!" << endl;
+         exit(-1);
+      }
+      // no tables yet: try a smaller size
+      cerr << "pawn hash table allocation failed, trying a smaller size" << endl;
+      entries /= 2;
+   }
 }
 
 int Scoring::tradeDownIndex(const Material &ourmat, const Material &oppmat)
@@ -366,10 +504,8 @@ int Scoring::tradeDownIndex(const Material &ourmat, const Material &oppmat)
    return index;
 }
 
-int Scoring::adjustMaterialScore(const Board &board, ColorType side) const
+int Scoring::adjustMaterialScore(const Material &ourmat, const Material &oppmat) const
 {
-    const Material &ourmat = board.getMaterial(side);
-    const Material &oppmat = board.getMaterial(OppositeColor(side));
     int score = 0;
 #ifdef EVAL_DEBUG
     int tmp = score;
@@ -402,7 +538,7 @@ int Scoring::adjustMaterialScore(const Board &board, ColorType side) const
              }
           }
 #ifdef EVAL_DEBUG
-          cout << "minor piece adjustment (" << ColorImage(side) << ") = " << score << endl;
+          cout << "minor piece adjustment = " << score << endl;
 #endif
           return score;
        }
@@ -472,7 +608,7 @@ int Scoring::adjustMaterialScore(const Board &board, ColorType side) const
     }
 #ifdef EVAL_DEBUG
     if (score-tmp)
-       cout << "material imbalance (" << ColorImage(side) << ") = " << score-tmp << endl;
+       cout << "material imbalance = " << score-tmp << endl;
 #endif
     // Encourage trading pieces (but not pawns) when we are ahead in material.
     int index = tradeDownIndex(ourmat,oppmat);
@@ -500,7 +636,7 @@ int Scoring::adjustMaterialScore(const Board &board, ColorType side) const
        score += (4-ourmat.materialLevel()/4)*adj/4;
 #ifdef EVAL_DEBUG
        if (score-tmp) {
-          cout << "pawn adjust (" << ColorImage(side) << ") = " << score-tmp << endl;
+          cout << "pawn adjust = " << score-tmp << endl;
        }
 #endif
     }
@@ -508,11 +644,9 @@ int Scoring::adjustMaterialScore(const Board &board, ColorType side) const
 }
 
 
-int Scoring::adjustMaterialScoreNoPawns( const Board &board, ColorType side ) const
+int Scoring::adjustMaterialScoreNoPawns(const Material &ourmat, const Material &oppmat) const
 {
     // pawnless endgames. Generally drawish in many cases.
-    const Material &ourmat = board.getMaterial(side);
-    const Material &oppmat = board.getMaterial(OppositeColor(side));
     int score = 0;
     if (ourmat.infobits() == Material::KQ) {
         if (oppmat.infobits() == Material::KRR) {
@@ -811,8 +945,6 @@ void Scoring::pieceScore(const Board &board,
       {
       case Knight:
          {
-            scores.mid += PARAM(KNIGHT_PST)[Midgame][scoreSq];
-            scores.end += PARAM(KNIGHT_PST)[Endgame][scoreSq];
 
             const Bitboard &knattacks = Attacks::knight_attacks[sq];
             const int mobl = PARAM(KNIGHT_MOBILITY)[Bitboard(knattacks &~board.allOccupied &~ourPawnData.opponent_pawn_attacks).bitCount()];
@@ -839,8 +971,6 @@ void Scoring::pieceScore(const Board &board,
 
       case Bishop:
          {
-            scores.mid += PARAM(BISHOP_PST)[Midgame][scoreSq];
-            scores.end += PARAM(BISHOP_PST)[Endgame][scoreSq];
 
             const Bitboard battacks(board.bishopAttacks(sq));
             allAttacks |= battacks;
@@ -881,8 +1011,6 @@ void Scoring::pieceScore(const Board &board,
 
       case Rook:
          {
-            scores.mid += PARAM(ROOK_PST)[Midgame][scoreSq];
-            scores.end += PARAM(ROOK_PST)[Endgame][scoreSq];
             const Bitboard rattacks(board.rookAttacks(sq));
             const int r = Rank(sq, side);
             if (r == 7 && (Rank(okp,side) == 8 || (board.pawn_bits[oside] & Attacks::rank7mask[side]))) {
@@ -950,8 +1078,6 @@ void Scoring::pieceScore(const Board &board,
 
       case Queen:
          {
-            scores.mid += PARAM(QUEEN_PST)[Midgame][scoreSq];
-            scores.end += PARAM(QUEEN_PST)[Endgame][scoreSq];
             int qmobl = 0;
 
             Bitboard battacks(board.bishopAttacks(sq));
@@ -1593,24 +1719,21 @@ void Scoring::calcPawnEntry(const Board &board, PawnHashEntry &pawnEntry) {
    pawnEntry.hc = board.pawnHash();
 }
 
-int Scoring::materialScore(const Board &board) const {
-    const ColorType side = board.sideToMove();
-    const Material &ourmat = board.getMaterial(side);
-    const Material &oppmat = board.getMaterial(OppositeColor(side));
-    const int mdiff =  (int)(ourmat.value() - oppmat.value());
+int Scoring::calcMaterialScore(const Material &wMat, const Material &bMat) const {
+    const int mdiff =  (int)(wMat.value() - bMat.value());
 #ifdef EVAL_DEBUG
     cout << "mdiff=" << mdiff << endl;
 
 #endif
     int adjust = 0;
-    if (ourmat.infobits() != oppmat.infobits()) {
-        if (ourmat.noPawns() && oppmat.noPawns()) {
-            adjust += adjustMaterialScoreNoPawns(board,side) -
-               adjustMaterialScoreNoPawns(board,OppositeColor(side));
+    if (wMat.infobits() != bMat.infobits()) {
+        if (wMat.noPawns() && bMat.noPawns()) {
+            adjust += adjustMaterialScoreNoPawns(wMat,bMat) -
+               adjustMaterialScoreNoPawns(bMat,wMat);
         }
         else {
-            adjust += adjustMaterialScore(board,side) -
-               adjustMaterialScore(board,OppositeColor(side));
+            adjust += adjustMaterialScore(wMat,bMat) -
+               adjustMaterialScore(bMat,wMat);
         }
     }
 #ifdef EVAL_DEBUG
@@ -1623,21 +1746,163 @@ int Scoring::materialScore(const Board &board) const {
     return matScore;
 }
 
+void Scoring::calcMaterialEntry(const Material &wMat, const Material &bMat,
+                                MaterialHashEntry &entry) {
+   entry.score = calcMaterialScore(wMat,bMat);
+   entry.endgame[White] = endgameFunction<White>(wMat,bMat);
+   entry.endgame[Black] = endgameFunction<Black>(bMat,wMat);
+   entry.key = ((hash_t)wMat.infobits() << 32) | (hash_t)bMat.infobits();
+}
+
+const Scoring::MaterialHashEntry &Scoring::materialEntry(const Board &board, bool useCache) {
+   const Material &wMat = board.getMaterial(White);
+   const Material &bMat = board.getMaterial(Black);
+   const hash_t key = ((hash_t)wMat.infobits() << 32) | (hash_t)bMat.infobits();
+   // Signatures differ mostly in their low bits, so mix them before
+   // taking the index.
+   MaterialHashEntry &entry = materialHashTable[
+      (key*0x9e3779b97f4a7c15ULL) >> (64-MATERIAL_HASH_BITS)];
+   cacheStats.materialProbes++;
+   if (!useCache || entry.key != key) {
+      calcMaterialEntry(wMat,bMat,entry);
+   } else {
+      cacheStats.materialHits++;
+   }
+   return entry;
+}
+
+int Scoring::materialScore(const Board &board) {
+   const int score = materialEntry(board,true).score;
+   return board.sideToMove() == White ? score : -score;
+}
+
+
+// Castled and can't-castle positions share a hash code (see
+// bhash.cpp) but are scored differently, so the eval cache key
+// includes the exact castle status.
+static inline hash_t evalCacheKey(const Board &board) {
+   return board.hashCode() ^
+      ((hash_t)(6*(int)board.castleStatus(White) +
+                (int)board.castleStatus(Black)) << 32);
+}
 
 int Scoring::evalu8(const Board &board, bool useCache) {
+   bool exact;
+   return evalu8(board,useCache,-Constants::MATE,Constants::MATE,exact);
+}
+
+int Scoring::evalu8(const Board &board, int alpha, int beta, bool &exact) {
+   return evalu8(board,true,alpha,beta,exact);
+}
+
+#ifdef USE_PREFETCH
+void Scoring::prefetchEvalEntries(const Board &board) const {
+   PREFETCH(&evalCache[evalCacheKey(board) & EVAL_CACHE_MASK]);
+   prefetchPawnEntry(board);
+   PREFETCH(&kingPawnHashTable[White][BoardHash::kingPawnHash(board,White) & kingPawnHashMask]);
+   PREFETCH(&kingPawnHashTable[Black][BoardHash::kingPawnHash(board,Black) & kingPawnHashMask]);
+}
+#endif
+
+void Scoring::evaluateBatch(const Board *boards, int n, int *out,
+                            bool useCache) {
+   for (int i = 0; i < n; i++) {
+#ifdef USE_PREFETCH
+      // overlap the table loads for the next position with scoring
+      // this one
+      if (useCache && i+1 < n) {
+         prefetchEvalEntries(boards[i+1]);
+      }
+#endif
+      out[i] = evalu8(boards[i],useCache);
+   }
+}
 
-   const int matScore = materialScore(board);
+int Scoring::evalu8(const Board &board, bool useCache, int alpha, int beta,
+                    bool &exact) {
+
+   exact = true;
+
+   const hash_t hc = evalCacheKey(board);
+   uint64 &cacheEntry = evalCache[hc & EVAL_CACHE_MASK];
+   if (useCache) {
+      cacheStats.evalProbes++;
+      if (((cacheEntry ^ hc) & EVAL_CACHE_KEY_MASK) == 0) {
+         cacheStats.evalHits++;
+         return (int)(int32)(uint32)cacheEntry;
+      }
+   }
+
+   const MaterialHashEntry &matEntry = materialEntry(board,useCache);
 
    const hash_t pawnHash = board.pawnHashCodeW ^ board.pawnHashCodeB;
 
-   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash % PAWN_HASH_SIZE];
+   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash & pawnHashMask];
 
+   cacheStats.pawnProbes++;
    if (!useCache || pawnEntry.hc != pawnHash) {
       // Not found in table, need to calculate
       calcPawnEntry(board, pawnEntry);
+   } else {
+      cacheStats.pawnHits++;
+   }
+
+   // Piece-square scores are kept incrementally by the Board, except
+   // when tuning, where the parameters change under existing boards.
+#ifdef TUNE
+   PstScores wPst, bPst;
+   calcPstScores(board,White,wPst);
+   calcPstScores(board,Black,bPst);
+#else
+   const PstScores &wPst = board.state.pst[White];
+   const PstScores &bPst = board.state.pst[Black];
+#ifdef _DEBUG
+   PstScores wPst2, bPst2;
+   calcPstScores(board,White,wPst2);
+   calcPstScores(board,Black,bPst2);
+   if (wPst.mid != wPst2.mid || wPst.end != wPst2.end ||
+       bPst.mid != bPst2.mid || bPst.end != bPst2.end) {
+      cout << board << endl;
+      cout << "incremental PST: (" << wPst.mid << "," << wPst.end << ") (" <<
+         bPst.mid << "," << bPst.end << ") computed: (" << wPst2.mid << "," <<
+         wPst2.end << ") (" << bPst2.mid << "," << bPst2.end << ")" << endl;
+      ASSERT(0);
    }
+#endif
+#endif
 
+   // Start with the cheap terms: piece-square and pawn structure
+   // scores (the latter from the pawn hash entry).
    Scores wScores, bScores;
+   wScores.mid = wPst.mid + pawnEntry.wPawnData.midgame_score;
+   wScores.end = wPst.end + pawnEntry.wPawnData.endgame_score;
+   bScores.mid = bPst.mid + pawnEntry.bPawnData.midgame_score;
+   bScores.end = bPst.end + pawnEntry.bPawnData.endgame_score;
+
+   const int w_materialLevel = board.getMaterial(White).materialLevel();
+   const int b_materialLevel = board.getMaterial(Black).materialLevel();
+
+   // Lazy eval: if the cheap terms put the score outside the window by
+   // more than the remaining terms can plausibly make up, return the
+   // estimate. Not done in endgames, where the remaining (king
+   // position, passed pawn and special-case endgame) terms can be
+   // large.
+   if ((alpha > -Constants::MATE || beta < Constants::MATE) &&
+       w_materialLevel > PARAM(ENDGAME_THRESHOLD) &&
+       b_materialLevel > PARAM(ENDGAME_THRESHOLD)) {
+      int est = wScores.blend(b_materialLevel) - bScores.blend(w_materialLevel);
+      if (strength < 100) {
+         est = est * Util::Max(100,strength*strength) / 10000;
+      }
+      est += matEntry.score;
+      if (board.sideToMove() == Black) {
+         est = -est;
+      }
+      if (est - LAZY_MARGIN >= beta || est + LAZY_MARGIN <= alpha) {
+         exact = false;
+         return est;
+      }
+   }
 
    KingPawnHashEntry &whiteKPEntry = getKPEntry<White>(board,pawnEntry.pawnData(White),pawnEntry.pawnData(Black),useCache);
    KingPawnHashEntry &blackKPEntry = getKPEntry<Black>(board,pawnEntry.pawnData(Black),pawnEntry.pawnData(White),useCache);
@@ -1648,9 +1913,6 @@ int Scoring::evalu8(const Board &board, bool useCache) {
    positionalScore<White> (board, pawnEntry, whiteCover, blackCover, wScores, bScores);
    positionalScore<Black> (board, pawnEntry, blackCover, whiteCover, bScores, wScores);
 
-   const int w_materialLevel = board.getMaterial(White).materialLevel();
-   const int b_materialLevel = board.getMaterial(Black).materialLevel();
-
    // Endgame scoring
    if (b_materialLevel <= PARAM(ENDGAME_THRESHOLD))
    {
@@ -1659,7 +1921,7 @@ int Scoring::evalu8(const Board &board, bool useCache) {
 #endif
       ASSERT(whiteKPEntry.king_endgame_position != Scoring::INVALID_SCORE);
       scoreEndgame<White>(board, whiteKPEntry.king_endgame_position,
-                   wScores);
+                   matEntry.endgame[White], wScores);
 #ifdef EVAL_DEBUG
       cout << "endgame score (White)=" << wScores.end - tmp << endl;
 #endif
@@ -1672,7 +1934,8 @@ int Scoring::evalu8(const Board &board, bool useCache) {
 #endif
       ASSERT(blackKPEntry.king_endgame_position != Scoring::INVALID_SCORE);
       scoreEndgame<Black>(board,
-                   blackKPEntry.king_endgame_position, bScores);
+                   blackKPEntry.king_endgame_position,
+                   matEntry.endgame[Black], bScores);
 #ifdef EVAL_DEBUG
       cout << "endgame score (Black)=" << bScores.end - tmp << endl;
 #endif
@@ -1694,16 +1957,13 @@ int Scoring::evalu8(const Board &board, bool useCache) {
    // scale scores by game phase
    int score = wScores.blend(b_materialLevel) - bScores.blend(w_materialLevel);
 
-   if (options.search.strength < 100) {
+   if (strength < 100) {
       // "flatten" positional score values
-      score = score * Util::Max(100,options.search.strength*options.search.strength) / 10000;
+      score = score * Util::Max(100,strength*strength) / 10000;
    }
 
-   // add material score, which is from the perspective of the side to move
-   if (board.sideToMove() == White)
-      score += matScore;
-   else
-      score -= matScore;
+   // add material score, which is from White's perspective
+   score += matEntry.score;
 
    if (board.sideToMove() == Black) {
       score = -score;
@@ -1720,6 +1980,7 @@ int Scoring::evalu8(const Board &board, bool useCache) {
    }
 #endif
 
+   cacheEntry = (hc & EVAL_CACHE_KEY_MASK) | (uint64)(uint32)score;
    return score;
 }
 
@@ -1737,8 +1998,7 @@ void Scoring::pawnScore(const Board &board, ColorType side, const PawnHashEntry:
 #ifdef PAWN_DEBUG
    Scores tmp(scores);
 #endif
-   scores.mid += pawnData.midgame_score;
-   scores.end += pawnData.endgame_score;
+   // (the base pawn structure scores are added by evalu8)
 
    if (board.rook_bits[OppositeColor(side)] | board.queen_bits[OppositeColor(side)]) {
 #ifdef PAWN_DEBUG
@@ -1890,101 +2150,127 @@ void Scoring::pawnScore(const Board &board, ColorType side, const PawnHashEntry:
 #endif
 }
 
-int Scoring::kingDistanceScore(const Board &board) const
+int Scoring::kingDistanceScore(const Board &board)
 {
    return PARAM(KING_DISTANCE_BASIS) - PARAM(KING_DISTANCE_MULT)*distance(board.kingSquare(White), board.kingSquare(Black));
 }
 
-// returns 1 if we evaluated a special-case endgame
+// Select the special-case endgame evaluator (piece or pawn vs. bare
+// King) for "side", if any.
 template <ColorType side>
-int Scoring::specialCaseEndgame(const Board &board,
-                                const Material &ourMaterial,
-                                const Material &oppMaterial,
-                                Scores &scores)
+Scoring::EndgameFunction Scoring::endgameFunction(const Material &ourMaterial,
+                                                  const Material &oppMaterial)
 {
    if (oppMaterial.kingOnly()) {
-      // code for some special-case endgames, pawn or piece vs bare King
-      const ColorType oside = OppositeColor(side);
-      if (ourMaterial.infobits() == Material::KP) {
-         Square pawnSq = board.pawn_bits[side].firstOne();
-         if (lookupBitbase(board.kingSquare(oside), pawnSq, board.kingSquare(side), side, board.sideToMove())) {
+      switch (ourMaterial.infobits()) {
+      case Material::KP:
+         return endgameKPK<side>;
+      case Material::KBN:
+         return endgameKBNK<side>;
+      case Material::KR:
+         return endgameKRK<side>;
+      case Material::KQ:
+         return endgameKQK<side>;
+      default:
+         break;
+      }
+   }
+   return NULL;
+}
+
+// returns 1 if the pawn is known to queen (from the bitbase)
+template <ColorType side>
+int Scoring::endgameKPK(const Board &board, Scores &scores)
+{
+   const ColorType oside = OppositeColor(side);
+   Square pawnSq = board.pawn_bits[side].firstOne();
+   if (lookupBitbase(board.kingSquare(oside), pawnSq, board.kingSquare(side), side, board.sideToMove())) {
 #ifdef PAWN_DEBUG
-            cout << ColorImage(side) << " pawn on " << SquareImage(pawnSq) << " is uncatchable" << endl;
+      cout << ColorImage(side) << " pawn on " << SquareImage(pawnSq) << " is uncatchable" << endl;
 #endif
-            scores.end = BITBASE_WIN;
-            return 1;
-         }
-      }
-      else if (ourMaterial.infobits() == Material::KBN) {
-         // KBNK endgame, special case.
-         Square oppkp = board.kingSquare(oside);
-         Bitboard bishops(board.bishop_bits[side]);
-         Square sq = bishops.firstOne();
+      scores.end = BITBASE_WIN;
+      return 1;
+   }
+   return 0;
+}
 
-         // try to force king to a corner where mate is possible.
-         if (SquareColor(sq) == Black) {
-            scores.end += KBNKScores[Flip[oppkp]];
-         }
-         else {
-            scores.end += KBNKScores[oppkp];
-         }
+template <ColorType side>
+int Scoring::endgameKBNK(const Board &board, Scores &scores)
+{
+   // KBNK endgame, special case.
+   Square oppkp = board.kingSquare(OppositeColor(side));
+   Bitboard bishops(board.bishop_bits[side]);
+   Square sq = bishops.firstOne();
 
-         // keep the kings close
-         scores.end += kingDistanceScore(board);
-         return 1;
-      } else if (ourMaterial.infobits() == Material::KR) {
-         // keep the kings close
-         scores.end += kingDistanceScore(board);
-         Square oppkp = board.kingSquare(oside);
-         // drive opposing king to the edge
-         scores.end -= KRScores[oppkp];
-         Square rookSq = board.rook_bits[side].firstOne();
-         int krank = Rank(oppkp,White);
-         int rrank = Rank(rookSq,White);
-         // Place the Rook so as to restrict the opposing King
-         if (krank >= 4) {
-            if (rrank == krank - 1) scores.end += 10*(10+(4-krank));
-         } else {
-            if (rrank == krank + 1) scores.end += 10*(10+(krank-4));
-         }
-         int kfile = File(oppkp);
-         int rfile = File(rookSq);
-         if (kfile >= 4) {
-            if (rfile == kfile-1) scores.end += 10*(10+(4-kfile));
-         } else {
-            if (rfile == kfile+1) scores.end += 10*(10+(kfile-4));
-         }
-         return 1;
-      } else if (ourMaterial.infobits() == Material::KQ) {
-         // keep the kings close
-         scores.end += kingDistanceScore(board);
-         Square oppkp = board.kingSquare(oside);
-         Square ourkp = board.kingSquare(side);
-         int krank = Rank(oppkp,White);
-         int kfile = File(oppkp);
-         if (InCorner(oppkp)) {
-            const int kingDistance = distance(board.kingSquare(White), board.kingSquare(Black));
-            if (kingDistance == 2) {
-               scores.end += 100;
-            }
-         } else if (OnEdge(oppkp)) {
-             // position King appropriately
-             if (kfile == chess::AFILE) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp + 1)) scores.end += 100;
-             } else if (kfile == chess::HFILE) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp - 1)) scores.end += 100;
-             } else if (krank == 1) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp+8)) scores.end += 100;
-             } else if (krank == 8) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp-8)) scores.end += 100;
-             }
-         }
-         // drive opposing king to the edge
-         scores.end -= KRScores[oppkp];
-         return 1;
-      }
+   // try to force king to a corner where mate is possible.
+   if (SquareColor(sq) == Black) {
+      scores.end += KBNKScores[Flip[oppkp]];
    }
-   return 0;
+   else {
+      scores.end += KBNKScores[oppkp];
+   }
+
+   // keep the kings close
+   scores.end += kingDistanceScore(board);
+   return 1;
+}
+
+template <ColorType side>
+int Scoring::endgameKRK(const Board &board, Scores &scores)
+{
+   // keep the kings close
+   scores.end += kingDistanceScore(board);
+   Square oppkp = board.kingSquare(OppositeColor(side));
+   // drive opposing king to the edge
+   scores.end -= KRScores[oppkp];
+   Square rookSq = board.rook_bits[side].firstOne();
+   int krank = Rank(oppkp,White);
+   int rrank = Rank(rookSq,White);
+   // Place the Rook so as to restrict the opposing King
+   if (krank >= 4) {
+      if (rrank == krank - 1) scores.end += 10*(10+(4-krank));
+   } else {
+      if (rrank == krank + 1) scores.end += 10*(10+(krank-4));
+   }
+   int kfile = File(oppkp);
+   int rfile = File(rookSq);
+   if (kfile >= 4) {
+      if (rfile == kfile-1) scores.end += 10*(10+(4-kfile));
+   } else {
+      if (rfile == kfile+1) scores.end += 10*(10+(kfile-4));
+   }
+   return 1;
+}
+
+template <ColorType side>
+int Scoring::endgameKQK(const Board &board, Scores &scores)
+{
+   // keep the kings close
+   scores.end += kingDistanceScore(board);
+   Square oppkp = board.kingSquare(OppositeColor(side));
+   Square ourkp = board.kingSquare(side);
+   int krank = Rank(oppkp,White);
+   int kfile = File(oppkp);
+   if (InCorner(oppkp)) {
+      const int kingDistance = distance(board.kingSquare(White), board.kingSquare(Black));
+      if (kingDistance == 2) {
+         scores.end += 100;
+      }
+   } else if (OnEdge(oppkp)) {
+      // position King appropriately
+      if (kfile == chess::AFILE) {
+         if (Attacks::king_attacks[ourkp].isSet(oppkp + 1)) scores.end += 100;
+      } else if (kfile == chess::HFILE) {
+         if (Attacks::king_attacks[ourkp].isSet(oppkp - 1)) scores.end += 100;
+      } else if (krank == 1) {
+         if (Attacks::king_attacks[ourkp].isSet(oppkp+8)) scores.end += 100;
+      } else if (krank == 8) {
+         if (Attacks::king_attacks[ourkp].isSet(oppkp-8)) scores.end += 100;
+      }
+   }
+   // drive opposing king to the edge
+   scores.end -= KRScores[oppkp];
+   return 1;
 }
 
 void Scoring::calcKingEndgamePosition(const Board &board, ColorType side,                                            const PawnHashEntry::PawnData &ourPawnData,
@@ -2055,13 +2341,9 @@ void Scoring::calcKingEndgamePosition(const Board &board, ColorType side,
 
 
 template<ColorType side>
-void Scoring::scoreEndgame(const Board &board,int k_pos,Scores &scores) {
-   const ColorType oside = OppositeColor(side);
-
-   const Material &ourMaterial = board.getMaterial(side);
-   const Material &oppMaterial = board.getMaterial(oside);
-
-   if (specialCaseEndgame<side>(board,ourMaterial,oppMaterial,scores)) {
+void Scoring::scoreEndgame(const Board &board,int k_pos,
+                           EndgameFunction endgame,Scores &scores) {
+   if (endgame && endgame(board,scores)) {
       return;
    }
 
@@ -2109,7 +2391,7 @@ void Scoring::scoreEndgame(const Board &board,int k_pos,Scores &scores) {
 
 Scoring::PawnHashEntry & Scoring::pawnEntry (const Board &board, bool useCache) {
    hash_t pawnHash = board.pawnHashCodeW ^ board.pawnHashCodeB;
-   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash % PAWN_HASH_SIZE];
+   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash & pawnHashMask];
    if (!useCache || pawnEntry.hc != pawnHash) {
       calcPawnEntry(board, pawnEntry);
    }
@@ -2123,10 +2405,11 @@ Scoring::KingPawnHashEntry &Scoring::getKPEntry(const Board &board,
 bool useCache)
 {
    hash_t kphash = BoardHash::kingPawnHash(board,side);
-   KingPawnHashEntry &entry = kingPawnHashTable[side][kphash % KING_PAWN_HASH_SIZE];
+   KingPawnHashEntry &entry = kingPawnHashTable[side][kphash & kingPawnHashMask];
    int mLevel = board.getMaterial(OppositeColor(side)).materialLevel();
    bool needCover = mLevel >= PARAM(MIDGAME_THRESHOLD);
    bool needEndgame = mLevel <= PARAM(ENDGAME_THRESHOLD);
+   cacheStats.kingPawnProbes++;
    if (!useCache || (entry.hc != kphash)) {
       if (needCover) {
          calcCover<side>(board,entry);
@@ -2141,6 +2424,7 @@ bool useCache)
       entry.hc = kphash;
    }
    else {
+      cacheStats.kingPawnHits++;
       if (needCover && entry.cover == Scoring::INVALID_SCORE) {
          calcCover<side>(board,entry);
       }
@@ -2206,13 +2490,9 @@ void Scoring::positionalScore(const Board &board, const PawnHashEntry &pawnEntry
       }
    }
 
-   // calculate penalties for damaged king cover
-   if (side == White) {
-      scores.mid += ownCover + PARAM(KING_PST)[Midgame][board.kingSquare(White)];
-   }
-   else {
-      scores.mid += ownCover + PARAM(KING_PST)[Midgame][63-board.kingSquare(Black)];
-   }
+   // calculate penalties for damaged king cover (the King's PST
+   // score is included in the Board's piece-square scores)
+   scores.mid += ownCover;
 
    pieceScore<side> (board, pawnEntry.pawnData(side),
                      pawnEntry.pawnData(oside), oppCover, scores, oppScores,
@@ -2409,11 +2689,25 @@ int Scoring::tryBitbase(const Board &board) {
    return INVALID_SCORE;
 }
 
+void Scoring::clearEvalCache() {
+   // An empty entry must not match any hash code likely to occur, so
+   // use the same filler as the pawn hash table.
+   for (hash_t i = 0; i <= EVAL_CACHE_MASK; i++) {
+      evalCache[i] = (uint64)0xababababababababULL;
+   }
+}
+
 void Scoring::clearHashTables() {
-   for (int i = 0; i < PAWN_HASH_SIZE; i++) {
+   clearEvalCache();
+   // an empty entry has a zero key, which no valid signature pair
+   // produces (each side always has a King)
+   for (int i = 0; i < MATERIAL_HASH_SIZE; i++) {
+      materialHashTable[i].key = (hash_t)0;
+   }
+   for (hash_t i = 0; i <= pawnHashMask; i++) {
       pawnHashTable[i].hc = (hash_t)0xababababababababULL;
    }
-   for (int i = 0; i < KING_PAWN_HASH_SIZE; i++) {
+   for (hash_t i = 0; i <= kingPawnHashMask; i++) {
       kingPawnHashTable[White][i].hc = (hash_t)0;
       kingPawnHashTable[Black][i].hc = (hash_t)0;
    }
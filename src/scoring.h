@@ -6,6 +6,7 @@
 #include "board.h"
 #include "hash.h"
 #include "attacks.h"
+#include "options.h"
 
 #include <iostream>
 using namespace std;
@@ -26,13 +27,68 @@ class Scoring
 
     static void cleanup();
 
-    Scoring();
+    // Strength and pawn hash size are taken from opts.
+    explicit Scoring(const Options::SearchOptions &opts =
+                     Options::SearchOptions());
 
     ~Scoring();
+
+    // Set the pawn hash table size in bytes (rounded down to a power
+    // of two number of entries). The king/pawn hash tables are sized
+    // in proportion. If the size changes, all entries are cleared.
+    // If the tables cannot be allocated, the current ones are kept,
+    // or if there are none a smaller size is used.
+    void setPawnHashSize(size_t bytes);
+
+    // Reduce positional scores for play at less than full strength
+    // (0 .. 100)
+    void setStrength(int s) {
+      if (s != strength) {
+         strength = s;
+         // cached scores depend on the strength setting
+         clearEvalCache();
+      }
+    }
+
+    // probe and hit counts for the eval cache and the pawn and
+    // king/pawn hash tables
+    struct CacheStats {
+      uint64 evalProbes, evalHits;
+      uint64 materialProbes, materialHits;
+      uint64 pawnProbes, pawnHits;
+      uint64 kingPawnProbes, kingPawnHits;
+    };
+
+    const CacheStats &getCacheStats() const {
+      return cacheStats;
+    }
+
+    void clearCacheStats() {
+      memset(&cacheStats,'\0',sizeof(CacheStats));
+    }
         
     // evaluate "board" from the perspective of the side to move.
     int evalu8( const Board &board, bool useCache = true );
 
+    // Evaluate "board" given the search window [alpha,beta]. If the
+    // cheap terms (material, pawn structure, piece-square) put the
+    // score outside the window by more than LAZY_MARGIN, the rest of
+    // the evaluation is skipped: "exact" is then set false and the
+    // cheap estimate is returned (it is not cached).
+    int evalu8( const Board &board, int alpha, int beta, bool &exact );
+
+    // Evaluate "n" positions, storing the scores (each from the
+    // perspective of its side to move) in "out". Results are the
+    // same as calling evalu8 on each board in turn; if built with
+    // USE_PREFETCH, the cache and hash table entries for the next
+    // position are loaded while the current one is scored.
+    void evaluateBatch( const Board *boards, int n, int *out,
+                        bool useCache = true );
+
+    // margin for the lazy eval bound: an estimate of how much the
+    // terms not in the cheap estimate can change the score
+    static const int LAZY_MARGIN;
+
     // checks for legal draws plus certain other theoretically
     // draw positions
     static int isDraw(const Board &board);
@@ -74,8 +130,9 @@ class Scoring
 
     void clearHashTables();
 
-    // return a material score
-    int materialScore( const Board &board ) const;
+    // return a material score (including imbalance and drawish
+    // material adjustments) from the perspective of the side to move
+    int materialScore( const Board &board );
 
     int outpost(const Board &board, Square sq, ColorType side) const;
 
@@ -100,13 +157,6 @@ class Scoring
     };
     typedef PawnDetail PawnDetails[8];
 
-#ifdef TUNE
-    static const int PAWN_HASH_SIZE = 8096;
-#else
-    static const int PAWN_HASH_SIZE = 16384;
-#endif
-    static const int KING_PAWN_HASH_SIZE = 8132;
-
     struct CACHE_ALIGN PawnHashEntry {
 
        hash_t hc;
@@ -131,7 +181,7 @@ class Scoring
        const PawnData &pawnData(ColorType side) const {
 	 return (side==White) ? wPawnData : bPawnData;
        }
-    } pawnHashTable[PAWN_HASH_SIZE];
+    };
 
     struct KingPawnHashEntry {
        hash_t hc;
@@ -139,10 +189,19 @@ class Scoring
        int32 king_endgame_position;
     };
 
-    KingPawnHashEntry kingPawnHashTable[2][KING_PAWN_HASH_SIZE];
-
     PawnHashEntry &pawnEntry(const Board &board, bool useCache);
 
+#ifdef USE_PREFETCH
+    // Start loading the pawn hash entry for "board" into cache.
+    void prefetchPawnEntry(const Board &board) const {
+       PREFETCH(&pawnHashTable[board.pawnHash() & pawnHashMask]);
+    }
+
+    // Start loading the eval cache, pawn and king/pawn hash entries
+    // for "board" into cache.
+    void prefetchEvalEntries(const Board &board) const;
+#endif
+
     template <ColorType side>
       KingPawnHashEntry &getKPEntry(const Board &board,
                         const PawnHashEntry::PawnData &ourPawnData,
@@ -188,9 +247,13 @@ class Scoring
     template <ColorType side>
         static int theoreticalDraw(const Board &board);
 
-    int adjustMaterialScore(const Board &board, ColorType side) const;
+    int adjustMaterialScore(const Material &ourmat, const Material &oppmat) const;
 
-    int adjustMaterialScoreNoPawns(const Board &board, ColorType side) const;
+    int adjustMaterialScoreNoPawns(const Material &ourmat, const Material &oppmat) const;
+
+    // material score from White's perspective, computed from the
+    // Material signatures only
+    int calcMaterialScore(const Material &wMat, const Material &bMat) const;
 
     template <ColorType bishopColor>
       void scoreBishopAndPawns(const Board &board,ColorType ourSide,const PawnHashEntry::PawnData &ourPawnData,const PawnHashEntry::PawnData &oppPawnData,Scores &scores,Scores &opp_scores);
@@ -229,17 +292,93 @@ class Scoring
     void pawnScore(const Board &board, ColorType side,
 		  const PawnHashEntry::PawnData &oppPawnData, Scores &);
 
+    // Evaluator for a special-case endgame (piece or pawn vs. bare
+    // King). Returns 1 if it scored the position, in which case the
+    // general endgame terms are not applied.
+    typedef int (*EndgameFunction)(const Board &, Scores &);
+
+    // Material table entry. Everything in it depends only on the
+    // Material signatures of the two sides, so it is computed once
+    // per signature pair instead of on every eval.
+    struct MaterialHashEntry {
+       hash_t key; // White infobits in high word, Black in low word
+       int32 score; // material score from White's perspective
+       // special-case endgame evaluator for each side, or NULL
+       EndgameFunction endgame[2];
+    };
+
+    const MaterialHashEntry &materialEntry(const Board &board, bool useCache);
+
+    void calcMaterialEntry(const Material &wMat, const Material &bMat,
+                           MaterialHashEntry &entry);
+
+    template <ColorType side>
+      void scoreEndgame(const Board &,int k_pos,EndgameFunction endgame,
+                        Scores &);
+
+    template <ColorType side>
+      static EndgameFunction endgameFunction(const Material &ourMaterial,
+                                             const Material &oppMaterial);
+
+    template <ColorType side>
+      static int endgameKPK(const Board &, Scores &);
+
+    template <ColorType side>
+      static int endgameKBNK(const Board &, Scores &);
+
     template <ColorType side>
-      void scoreEndgame(const Board &,int k_pos,Scores &);
+      static int endgameKRK(const Board &, Scores &);
 
     template <ColorType side>
-      int specialCaseEndgame(const Board &,
-                             const Material &ourMaterial,
-                             const Material &oppMaterial,
-                             Scores &);
+      static int endgameKQK(const Board &, Scores &);
+
+    static int kingDistanceScore(const Board &);
+
+    int evalu8(const Board &board, bool useCache, int alpha, int beta,
+               bool &exact);
+
+    // fill in Board::pstTable from the PST parameters
+    static void initPstTable();
+
+    // compute the piece-square scores for "side" from scratch
+    static void calcPstScores(const Board &board, ColorType side,
+                              PstScores &pst);
+
+    // Hash tables for pawn structure and king/pawn scores, indexed by
+    // hash code & mask (each table has a power of two size).
+    PawnHashEntry *pawnHashTable;
+    hash_t pawnHashMask;
+
+    // Cache of full evaluation scores, indexed by board hash code &
+    // EVAL_CACHE_MASK. Each entry packs the upper 32 bits of the hash
+    // code with the 32-bit score, so an entry is read and written as a
+    // single word and needs no lock (each Scoring instance belongs to
+    // one search thread in any case).
+    static const int EVAL_CACHE_SIZE = 1<<16;
+    static const hash_t EVAL_CACHE_MASK = EVAL_CACHE_SIZE-1;
+    static const hash_t EVAL_CACHE_KEY_MASK = 0xffffffff00000000ULL;
+    uint64 *evalCache;
+
+    // Material table, indexed by a hash of the two Material
+    // signatures. Few distinct signatures occur in a search, so this
+    // is small.
+    static const int MATERIAL_HASH_BITS = 11;
+    static const int MATERIAL_HASH_SIZE = 1<<MATERIAL_HASH_BITS;
+    MaterialHashEntry *materialHashTable;
+
+    void clearEvalCache();
+    KingPawnHashEntry *kingPawnHashTable[2];
+    hash_t kingPawnHashMask;
+
+    CacheStats cacheStats;
+
+    int strength;
 
-    int kingDistanceScore(const Board &) const;
+    void freePawnHash();
 
+    // not copyable: the hash tables are owned by the instance
+    Scoring(const Scoring &);
+    Scoring & operator = (const Scoring &);
 };
 
 #endif
@@ -58,9 +58,55 @@ static const double LMR_NON_PV = 1.5;
 static const double LMR_PV = 2.25;
 static const int MAX_SPLIT_DEPTH=16*DEPTH_INCREMENT;
 static const int MIN_SPLIT_DEPTH=5*DEPTH_INCREMENT;
+// Split depth controller parameters: measurement interval (msec),
+// target range for the fraction of thread time spent idle, and the
+// maximum fraction of thread time to spend setting up split points.
+static const unsigned SPLIT_SAMPLE_INTERVAL = 50;
+static const double MIN_IDLE = 0.03;
+static const double MAX_IDLE = 0.10;
+static const double MAX_SPLIT_OVERHEAD = 0.02;
 
 static int CACHE_ALIGN LMR_REDUCTION[2][64][64];
 
+// Compute the LMR reduction table. This is read-only once filled in,
+// and shared by all SearchController instances, so it is computed
+// once, during static initialization.
+static bool initReductions() {
+    for (int d = 0; d < 64; d++) {
+      for (int moves= 0; moves < 64; moves++) {
+        LMR_REDUCTION[0][d][moves] =
+           LMR_REDUCTION[1][d][moves] = 0;
+        if (d >= 2 && moves > 0) {
+           // Formula similar to Protector & Toga. Tuned Aug. 2015
+           double f = LMR_BASE + log((double)d) * log((double)moves+1);
+           const double reduction[2] = {f/LMR_NON_PV, f/LMR_PV};
+           for (int i = 0; i < 2; i++) {
+              double r = floor(reduction[i]+0.5);
+              // do not reduce into the q-search
+              r = std::min<double>(r,double(d-1)-1.0/DEPTH_INCREMENT);
+              // limit LMR to fraction of depth
+              r = std::min<double>(d/2.5,r);
+              // do not do reductions < 1 ply
+              if (r < 1.0) r = 0.0;
+              // only reduce in units of DEPTH_INCREMENT
+              LMR_REDUCTION[i][d][moves] = DEPTH_INCREMENT*int(r);
+           }
+        }
+      }
+    }
+/*
+    for (int i = 0; i < 64; i++) {
+      cout << "--- i=" << i << endl;
+      for (int m=0; m<64; m++) {
+      cout << m << " " << LMR_REDUCTION[0][i][m] << ' ' << LMR_REDUCTION[1][i][m] << endl;
+      }
+    }
+*/
+    return true;
+}
+
+static const bool reductionsInitialized = initReductions();
+
 static const int LMP_DEPTH=10;
 
 static const int LMP_MOVE_COUNT[11] = {3, 3, 5, 9, 15, 23, 33, 45, 59, 75, 93
@@ -104,9 +150,15 @@ static const int NODE_ACCUM_THRESHOLD = 16;
 static const int SAMPLE_INTERVAL = 10000/NODE_ACCUM_THRESHOLD;
 #endif
 
-static int Time_Check_Interval;
-
-static unsigned last_time = 0;
+#ifdef USE_PREFETCH
+// Start fetching the hash bucket for the position after "move", so
+// the memory access overlaps move making. Keys include the repetition
+// code, so assume the usual case of no repetition.
+static inline void prefetchHash(const Hash &hashTable,
+                                 const Board &board, Move move) {
+   hashTable.prefetch(board.hashCode(move) ^ rep_codes[0]);
+}
+#endif
 
 static const int Illegal = Scoring::INVALID_SCORE;
 static const int PRUNE = -Constants::MATE;
@@ -140,53 +192,61 @@ SearchController::SearchController()
     stopped(false),
     ratingDiff(0),
     ratingFactor(0),
-    active(false) {
+    active(false),
+    hashClearPending(false) {
+    learnOpts = options.learning;
+    init(options.search);
+}
+
+SearchController::SearchController(const Options::SearchOptions &opts,
+                                   const Options::LearningOptions &learning)
+  : post_function(NULL),
+    terminate_function(NULL),
+    age(1),
+    talkLevel(Silent),
+    stopped(false),
+    ratingDiff(0),
+    ratingFactor(0),
+    active(false),
+    hashClearPending(false) {
+    learnOpts = learning;
+    init(opts);
+}
 
+void SearchController::init(const Options::SearchOptions &opts) {
+    // set before creating the pool, since the Search instances
+    // copy their options from here
+    srcOpts = opts;
 #ifdef SMP_STATS
     sample_counter = SAMPLE_INTERVAL;
 #endif
     LockInit(split_calc_lock);
-    pool = new ThreadPool(this,options.search.ncpus);
+    LockInit(snapshot_lock);
+    snapshotId = 0;
+    pool = new ThreadPool(this,srcOpts.ncpus);
     ThreadInfo *ti = pool->mainThread();
     ti->state = ThreadInfo::Working;
     rootSearch = (RootSearch*)ti->work;
-    for (int d = 0; d < 64; d++) {
-      for (int moves= 0; moves < 64; moves++) {
-        LMR_REDUCTION[0][d][moves] =
-           LMR_REDUCTION[1][d][moves] = 0;
-        if (d >= 2 && moves > 0) {
-           // Formula similar to Protector & Toga. Tuned Aug. 2015
-           double f = LMR_BASE + log((double)d) * log((double)moves+1);
-           const double reduction[2] = {f/LMR_NON_PV, f/LMR_PV};
-           for (int i = 0; i < 2; i++) {
-              double r = floor(reduction[i]+0.5);
-              // do not reduce into the q-search
-              r = std::min<double>(r,double(d-1)-1.0/DEPTH_INCREMENT);
-              // limit LMR to fraction of depth
-              r = std::min<double>(d/2.5,r);
-              // do not do reductions < 1 ply
-              if (r < 1.0) r = 0.0;
-              // only reduce in units of DEPTH_INCREMENT
-              LMR_REDUCTION[i][d][moves] = DEPTH_INCREMENT*int(r);
-           }
-        }
-      }
-    }
-/*
-    for (int i = 0; i < 64; i++) {
-      cout << "--- i=" << i << endl;
-      for (int m=0; m<64; m++) {
-      cout << m << " " << LMR_REDUCTION[0][i][m] << ' ' << LMR_REDUCTION[1][i][m] << endl;
-      }
-    }
-*/
-    hashTable.initHash((size_t)(options.search.hash_table_size));
+    // Have the pool threads first-touch the table memory
+    hashTable.setMemoryOptions(srcOpts.large_pages,srcOpts.numa_interleave);
+    hashTable.allocHash((size_t)(srcOpts.hash_table_size));
+    startHashClear();
 }
 
 SearchController::~SearchController() {
+   waitForHashClear();
    delete pool;
    hashTable.freeHash();
    LockDestroy(split_calc_lock);
+   LockDestroy(snapshot_lock);
+}
+
+void SearchController::saveSnapshot(Search *s) {
+   Lock(snapshot_lock);
+   historySnapshot = s->context.history;
+   refutationsSnapshot = s->context.refutations;
+   s->snapshotId = ++snapshotId;
+   Unlock(snapshot_lock);
 }
 
 void SearchController::terminateNow() {
@@ -228,6 +288,10 @@ Move SearchController::findBestMove(
    TalkLevel t,
    Move *exclude, int num_exclude)
 {
+    waitForHashClear();
+    if (learnOpts.position_learning) {
+        hashTable.loadLearnInfo(board);
+    }
     this->typeOfSearch = srcType;
     this->time_limit = time_target = time_limit;
     time_added = 0;
@@ -246,18 +310,24 @@ Move SearchController::findBestMove(
     this->stats = &stat_buf;
 
     // set initial thread split depth based on number of CPUS and material
-    threadSplitDepth = 6*DEPTH_INCREMENT + (options.search.ncpus/8)*DEPTH_INCREMENT/2;
+    // (the thread count term is capped so that very large pools still
+    // split at depths the search actually reaches)
+    threadSplitDepth = 6*DEPTH_INCREMENT + (Util::Min(srcOpts.ncpus,64)/8)*DEPTH_INCREMENT/2;
     int mat = board.getMaterial(board.sideToMove()).materialLevel();
     if (mat < 16) threadSplitDepth += DEPTH_INCREMENT/2;
     if (mat < 12) threadSplitDepth += DEPTH_INCREMENT;
+    splitSampleTime = getCurrentTime();
+    splitSampleNodes = splitSampleSplits = splitSampleCost = 0;
+    splitActiveSamples = splitActiveSum = 0;
+    idleAvg = splitOverheadAvg = 0.0;
 
-    Time_Check_Interval = 4096/NODE_ACCUM_THRESHOLD;
+    time_check_interval = 4096/NODE_ACCUM_THRESHOLD;
     // reduce time check interval if time limit is very short (<1 sec)
     if (srcType == TimeLimit) {
        if (time_limit < 100) {
-          Time_Check_Interval = 1024/NODE_ACCUM_THRESHOLD;
+          time_check_interval = 1024/NODE_ACCUM_THRESHOLD;
        } else if (time_limit < 1000) {
-          Time_Check_Interval = 2048/NODE_ACCUM_THRESHOLD;
+          time_check_interval = 2048/NODE_ACCUM_THRESHOLD;
        }
     }
     computerSide = board.sideToMove();
@@ -278,12 +348,32 @@ Move SearchController::findBestMove(
 
     // reset terminate flag on all threads
     clearStopFlags();
+#ifdef SMP_STATS
+    pool->clearStats();
+#endif
 
     NodeStack rootStack;
     rootSearch->init(board,rootStack);
     startTime = getCurrentTime();
 
-    return rootSearch->ply0_search(exclude,num_exclude);
+    // Start the helper threads. The helper search must not run on
+    // this thread, so if no pool thread is idle the search runs
+    // without helpers. (The root search does not split in this mode.)
+    const bool lazy = srcOpts.lazy_smp && pool->nThreads > 1 &&
+        pool->runTask(lazyHelper,this,false,true);
+    Move result = rootSearch->ply0_search(exclude,num_exclude);
+    if (lazy) {
+        stopHelpers();
+        pool->waitForTask();
+    }
+    return result;
+}
+
+void SearchController::lazyHelper(void *arg, ThreadInfo *ti, unsigned, unsigned)
+{
+    SearchController *controller = (SearchController*)arg;
+    ASSERT(ti->index);
+    ti->work->lazySearch(controller->rootSearch->getInitialBoard());
 }
 
 void SearchController::setRatingDiff(int rdiff)
@@ -309,6 +399,7 @@ int SearchController::wasTerminated() const {
 }
 
 void SearchController::setThreadCount(int threads) {
+   srcOpts.ncpus = threads;
    pool->resize(threads,this);
 }
 
@@ -322,6 +413,66 @@ void SearchController::setThreadSplitDepth(int depth) {
    pool->forEachSearch<&Search::setSplitDepthFromController>();
 }
 
+void SearchController::adjustSplitDepth(CLOCK_TYPE current_time) {
+    // Any searching thread may call this. Only one runs the
+    // controller at a time: the others skip it rather than wait.
+    if (!TryLock(split_calc_lock)) return;
+    splitActiveSum += pool->activeCount();
+    splitActiveSamples++;
+    const unsigned interval = getElapsedTime(splitSampleTime,current_time);
+    if (interval >= SPLIT_SAMPLE_INTERVAL && splitActiveSamples >= 4) {
+        const unsigned threads = pool->nThreads;
+        const uint64 nodes = stats->num_nodes - splitSampleNodes;
+        const uint64 splits = stats->splits - splitSampleSplits;
+        // fraction of thread time spent idle (sampled), and spent
+        // setting up split points (split_time is in nanoseconds)
+        const double idle = 1.0 -
+           double(splitActiveSum)/(double(splitActiveSamples)*threads);
+        const double overhead = double(stats->split_time - splitSampleCost)/
+           (1.0e6*interval*threads);
+        // smooth the measurements so that one unusual interval (such
+        // as the start of an iteration) does not move the depth far
+        idleAvg = (idleAvg + idle)/2;
+        splitOverheadAvg = (splitOverheadAvg + overhead)/2;
+        // Splitting at lower depths keeps more threads busy but costs
+        // more set-up time per node searched. Move in small steps, and
+        // not at all while both measures are in range, to avoid
+        // oscillating.
+        int step = 0;
+        if (splitOverheadAvg > MAX_SPLIT_OVERHEAD) {
+            step = splitOverheadAvg > 2*MAX_SPLIT_OVERHEAD ?
+               DEPTH_INCREMENT/2 : DEPTH_INCREMENT/4;
+        }
+        else if (idleAvg > MAX_IDLE) {
+            step = idleAvg > 2*MAX_IDLE ?
+               -DEPTH_INCREMENT/2 : -DEPTH_INCREMENT/4;
+        }
+        else if (idleAvg < MIN_IDLE &&
+                 splitOverheadAvg > MAX_SPLIT_OVERHEAD/4) {
+            // threads are busy enough, so splits can be saved
+            step = DEPTH_INCREMENT/4;
+        }
+        const int depth = Util::Max(MIN_SPLIT_DEPTH,
+                                    Util::Min(MAX_SPLIT_DEPTH,
+                                              threadSplitDepth + step));
+        if (talkLevel == Trace) {
+            cout << "# split depth " << float(depth)/DEPTH_INCREMENT <<
+               ": idle " << 100.0*idleAvg << "%, split overhead " <<
+               100.0*splitOverheadAvg << "%, nodes/split " <<
+               (splits ? nodes/splits : 0) << endl;
+        }
+        if (depth != threadSplitDepth) {
+            setThreadSplitDepth(depth);
+        }
+        splitSampleTime = current_time;
+        splitSampleNodes = stats->num_nodes;
+        splitSampleSplits = stats->splits;
+        splitSampleCost = stats->split_time;
+        splitActiveSamples = splitActiveSum = 0;
+    }
+    Unlock(split_calc_lock);
+}
+
 void SearchController::updateStats(NodeInfo *node, int iteration_depth,
 int score, int alpha, int beta)
 {
@@ -413,21 +564,60 @@ void SearchController::clearHashTables()
 {
     age = 0;
     pool->forEachSearch<&Search::clearHashTables>();
-    hashTable.clearHash();
+    startHashClear();
+}
+
+static void clearHashSlice(void *arg, ThreadInfo *, unsigned slice, unsigned slices)
+{
+    ((Hash*)arg)->clearSlice(slice,slices);
+}
+
+void SearchController::startHashClear()
+{
+    waitForHashClear();
+    hashClearPending = true;
+    pool->runTask(clearHashSlice,&hashTable,false);
+}
+
+void SearchController::waitForHashClear()
+{
+    if (hashClearPending) {
+        pool->waitForTask();
+        hashTable.clearDone();
+        hashClearPending = false;
+    }
 }
 
 void SearchController::stopAllThreads() {
     pool->forEachSearch<&Search::stop>();
 }
 
+void SearchController::stopHelpers() {
+    Lock(pool->poolLock);
+    for (unsigned i = 1; i < pool->nThreads; i++) {
+        if (pool->data[i]->work) {
+            pool->data[i]->work->stop();
+        }
+    }
+    Unlock(pool->poolLock);
+}
+
 void SearchController::clearStopFlags() {
     pool->forEachSearch<&Search::clearStopFlag>();
 }
 
 void SearchController::updateSearchOptions() {
+    learnOpts = options.learning;
+    updateSearchOptions(options.search);
+}
+
+void SearchController::updateSearchOptions(const Options::SearchOptions &opts) {
+    srcOpts = opts;
+    // applies when the hash table is next allocated
+    hashTable.setMemoryOptions(srcOpts.large_pages,srcOpts.numa_interleave);
     // pool size is part of search options and may have changed,
     // so adjust that first:
-    pool->resize(options.search.ncpus,this);
+    pool->resize(srcOpts.ncpus,this);
     // update each search thread's local copy of the options:
     pool->forEachSearch<&Search::setSearchOptions>();
 }
@@ -453,13 +643,71 @@ void SearchController::uciSendInfos(const Board &board, Move move, int move_inde
    }
 }
 
+void SearchController::getHashStats(HashStats &stats) const
+{
+    stats.clear();
+    Lock(pool->poolLock);
+    for (unsigned i = 0; i < pool->nThreads; i++) {
+        if (pool->data[i] && pool->data[i]->work) {
+            const Search *s = pool->data[i]->work;
+            stats += s->hashStats;
+            const Scoring::CacheStats &p = s->scoring.getCacheStats();
+            stats.evalProbes += p.evalProbes;
+            stats.evalHits += p.evalHits;
+            stats.materialProbes += p.materialProbes;
+            stats.materialHits += p.materialHits;
+            stats.pawnProbes += p.pawnProbes;
+            stats.pawnHits += p.pawnHits;
+            stats.kingPawnProbes += p.kingPawnProbes;
+            stats.kingPawnHits += p.kingPawnHits;
+        }
+    }
+    Unlock(pool->poolLock);
+}
+
+void SearchController::clearHashStats()
+{
+    Lock(pool->poolLock);
+    for (unsigned i = 0; i < pool->nThreads; i++) {
+        if (pool->data[i] && pool->data[i]->work) {
+            pool->data[i]->work->hashStats.clear();
+            pool->data[i]->work->scoring.clearCacheStats();
+        }
+    }
+    Unlock(pool->poolLock);
+}
+
+int SearchController::saveHash(const string &fileName)
+{
+    waitForHashClear();
+    return hashTable.saveHash(fileName);
+}
+
+int SearchController::loadHash(const string &fileName)
+{
+    waitForHashClear();
+    // Entries are aged as if from the previous search, so they can be
+    // replaced, but are kept if used in the next search. Age 0 is
+    // reserved for learned entries.
+    return hashTable.loadHash(fileName,age ? age : 255);
+}
+
+static void resizeHashSlice(void *arg, ThreadInfo *, unsigned slice, unsigned slices)
+{
+    ((Hash*)arg)->resizeSlice(slice,slices);
+}
+
 void SearchController::resizeHash(size_t newSize) {
-   hashTable.resizeHash(newSize);
+   waitForHashClear();
+   // Existing entries are copied into the new table, in parallel.
+   hashTable.beginResize(newSize,age);
+   pool->runTask(resizeHashSlice,&hashTable,true);
+   hashTable.resizeDone();
 }
 
 Search::Search(SearchController *c, ThreadInfo *threadInfo)
-   :controller(c),terminate(0),
-    activeSplitPoints(0),split(NULL),ti(threadInfo) {
+   :controller(c),snapshotId(0),terminate(0),nodeCount(0),
+    activeSplitPoints(0),split(NULL),scoring(c->srcOpts),ti(threadInfo) {
     LockInit(splitLock);
     setSearchOptions();
     // Ensure the thread creating this Search instance is the
@@ -484,28 +732,10 @@ int Search::checkTime(const Board &board,int ply) {
     Statistics *stats = controller->stats;
     CLOCK_TYPE current_time = getCurrentTime();
     stats->elapsed_time = getElapsedTime(controller->startTime,current_time);
-    // dynamically change the thread split depth based on # of splits
-    if (srcOpts.ncpus >1 && stats->elapsed_time > 100) {
-        // Lock the stats structure since other threads may try to
-        // modify it
-        Lock(controller->split_calc_lock);
-        if (current_time-stats->last_split_time > 50 &&
-            stats->splits-stats->last_split_sample > 0) {
-            int splitsPerSec = (int(stats->splits-stats->last_split_sample)*1000)/int(current_time-stats->last_split_time);
-            int target = srcOpts.ncpus*120;
-            if (splitsPerSec > 3*target/2) {
-               controller->setThreadSplitDepth(
-                  Util::Min(MAX_SPLIT_DEPTH,
-                             controller->threadSplitDepth + DEPTH_INCREMENT/2));
-            } else if (splitsPerSec < target/2) {
-               controller->setThreadSplitDepth(
-                  Util::Max(MIN_SPLIT_DEPTH,
-                              controller->threadSplitDepth - DEPTH_INCREMENT/2));
-            }
-            stats->last_split_sample = stats->splits;
-            stats->last_split_time = current_time;
-        }
-        Unlock(controller->split_calc_lock);
+    // dynamically change the thread split depth based on thread
+    // usage and split overhead
+    if (srcOpts.ncpus >1 && !srcOpts.lazy_smp && stats->elapsed_time > 100) {
+        controller->adjustSplitDepth(current_time);
     }
     if (controller->typeOfSearch == FixedTime) {
        if (stats->elapsed_time >= (unsigned)controller->time_target) {
@@ -544,12 +774,12 @@ int Search::checkTime(const Board &board,int ply) {
           return 1;
        }
     }
-    if (controller->uci && (current_time-last_time >= 2000)) {
+    if (controller->uci && (current_time-controller->last_info_time >= 2000)) {
         cout << "info";
         if (stats->elapsed_time>300) cout << " nps " <<
                 (long)((1000L*stats->num_nodes)/stats->elapsed_time);
         cout << " nodes " << stats->num_nodes << " hashfull " << controller->hashTable.pctFull() << endl;
-        last_time = current_time;
+        controller->last_info_time = current_time;
     }
     return 0;
 }
@@ -607,7 +837,7 @@ int Search::drawScore(const Board & board) const {
 void RootSearch::init(const Board &board, NodeStack &stack) {
   this->board = initialBoard = board;
   node = stack;
-  Refutations::clearRefutations();
+  context.refutations.clearRefutations();
   context.clearKiller();
   nodeAccumulator = 0;
   // local copy:
@@ -642,8 +872,8 @@ Move *excludes, int num_excludes)
    if (controller->uci) {
        controller->stats->multipv_limit = Util::Min(mg.moveCount(),srcOpts.multipv);
    }
-   controller->time_check_counter = Time_Check_Interval;
-   last_time = 0;
+   controller->time_check_counter = controller->time_check_interval;
+   controller->last_info_time = 0;
 
    int tb_hit = 0, tb_pieces = 0;
    int value = Scoring::INVALID_SCORE;
@@ -694,7 +924,7 @@ Move *excludes, int num_excludes)
                cout << "# waitTime=" << waitTime << endl;
            }
            // adjust time check interval since we are lowering nps
-           Time_Check_Interval = Util::Max(1,Time_Check_Interval / (1+8*int(factor)));
+           controller->time_check_interval = Util::Max(1,controller->time_check_interval / (1+8*int(factor)));
            if (srcOpts.strength <= 95) {
                static const int limits[25] = {1,1,1,1,1,1,1,1,
                                               2,2,2,2,3,3,4,6,8,9,10,
@@ -732,6 +962,11 @@ Move *excludes, int num_excludes)
         iteration_depth <= controller->ply_limit && !terminate;
         iteration_depth++) {
       if (!controller->explicit_excludes) num_excludes = 0;
+      if (srcOpts.ncpus > 1 && !srcOpts.lazy_smp) {
+         // No slaves are active between iterations, so the tables
+         // can be copied consistently here.
+         controller->saveSnapshot(this);
+      }
       for (multipv_count=0; multipv_count < srcOpts.multipv && !terminate; multipv_count++) {
          int lo_window, hi_window;
          int aspirationWindow = ASPIRATION_WINDOW[0];
@@ -739,8 +974,8 @@ Move *excludes, int num_excludes)
             lo_window = -Constants::MATE;
             hi_window = Constants::MATE;
          } else if (iteration_depth <= MoveGenerator::EASY_PLIES) {
-            lo_window = Util::Max(-Constants::MATE,value - options.search.easy_threshold);
-            hi_window = Util::Min(Constants::MATE,value + options.search.easy_threshold + aspirationWindow/2);
+            lo_window = Util::Max(-Constants::MATE,value - srcOpts.easy_threshold);
+            hi_window = Util::Min(Constants::MATE,value + srcOpts.easy_threshold + aspirationWindow/2);
          } else {
             lo_window = Util::Max(-Constants::MATE,value - aspirationWindow/2);
             hi_window = Util::Min(Constants::MATE,value + aspirationWindow/2);
@@ -797,12 +1032,12 @@ Move *excludes, int num_excludes)
                break;
             }
             if (stats->elapsed_time > 200) {
-               Time_Check_Interval = int((20L*stats->num_nodes)/(stats->elapsed_time*NODE_ACCUM_THRESHOLD));
+               controller->time_check_interval = int((20L*stats->num_nodes)/(stats->elapsed_time*NODE_ACCUM_THRESHOLD));
                if ((int)controller->time_limit - (int)stats->elapsed_time < 100) {
-                  Time_Check_Interval /= 2;
+                  controller->time_check_interval /= 2;
                }
                if (talkLevel == Trace) {
-                  cout << "# time check interval=" << Time_Check_Interval << " elapsed_time=" << stats->elapsed_time << " target=" << controller->getTimeLimit() << endl;
+                  cout << "# time check interval=" << controller->time_check_interval << " elapsed_time=" << stats->elapsed_time << " target=" << controller->getTimeLimit() << endl;
                }
             }
             if (terminate) {
@@ -843,7 +1078,7 @@ Move *excludes, int num_excludes)
                   hi_window = Constants::MATE-iteration_depth-1;
                } else {
                   if (iteration_depth <= MoveGenerator::EASY_PLIES) {
-                     aspirationWindow += 2*options.search.easy_threshold;
+                     aspirationWindow += 2*srcOpts.easy_threshold;
                   }
                   hi_window = Util::Min(Constants::MATE-iteration_depth-1,
                                         lo_window + aspirationWindow);
@@ -878,7 +1113,7 @@ Move *excludes, int num_excludes)
                   lo_window = iteration_depth-Constants::MATE-1;
                } else {
                   if (iteration_depth <= MoveGenerator::EASY_PLIES) {
-                     aspirationWindow += 2*options.search.easy_threshold;
+                     aspirationWindow += 2*srcOpts.easy_threshold;
                   }
                   lo_window = Util::Max(iteration_depth-Constants::MATE,hi_window - aspirationWindow);
                }
@@ -992,6 +1227,10 @@ Move *excludes, int num_excludes)
    Statistics *stats = controller->stats;
    StateType &state = stats->state;
    stats->end_of_game = end_of_game[(int)stats->state];
+#ifdef SMP_STATS
+   controller->pool->endStats();
+   controller->pool->getWakeStats(stats->wakeups,stats->wake_latency);
+#endif
    if (!controller->uci && !stats->end_of_game && srcOpts.can_resign) {
       if (stats->display_value != Scoring::INVALID_SCORE &&
          (100*stats->display_value)/PAWN_VALUE <= srcOpts.resign_threshold) {
@@ -1024,13 +1263,10 @@ Move *excludes, int num_excludes)
 #ifdef SEARCH_STATS
       cout << (stats->num_nodes-stats->num_qnodes) << " regular nodes, " <<
          stats->num_qnodes << " quiescence nodes." << endl;
-      cout << stats->hash_searches << " searches of hash table, " <<
-         stats->hash_hits << " successful";
-      if (stats->hash_searches != 0)
-         cout << " (" <<
-            (int)((100.0*(float)stats->hash_hits)/((float)stats->hash_searches)) <<
-            " percent).";
-      cout << endl;
+      cout << stats->lazy_evals << " lazy evals in quiescence search." << endl;
+      HashStats totalHashStats;
+      controller->getHashStats(totalHashStats);
+      totalHashStats.print(cout);
       cout << "hash table is " << setprecision(2) <<
           1.0F*controller->hashTable.pctFull()/10.0F << "% full." << endl;
 #endif
@@ -1065,6 +1301,15 @@ Move *excludes, int num_excludes)
 #if defined(SMP_STATS)
       cout << stats->splits << " splits," <<
          " average thread usage=" << (float)(stats->threads)/(float)stats->samples << endl;
+      if (srcOpts.ncpus > 1) {
+         cout << "split depth=" << (float)controller->threadSplitDepth/DEPTH_INCREMENT <<
+            ", idle=" << 100.0*controller->idleAvg << "%, split overhead=" <<
+            100.0*controller->splitOverheadAvg << '%' << endl;
+      }
+      if (stats->wakeups) {
+         cout << "average wakeup latency at split: " <<
+            (float)stats->wake_latency/(float)stats->wakeups << " usec." << endl;
+      }
 #endif
 #ifdef EVAL_STATS
       Scoring::showStats(cout);
@@ -1107,7 +1352,7 @@ int depth, Move exclude [], int num_exclude)
         // Note: do not do "easy move" if capturing the last piece in
         // the endgame .. this can be tricky as the resulting pawn
         // endgame may be lost.
-        if (list.size() > 1 && (list[0].score >= list[1].score + options.search.easy_threshold) && TypeOfMove(node->best) == Normal &&
+        if (list.size() > 1 && (list[0].score >= list[1].score + srcOpts.easy_threshold) && TypeOfMove(node->best) == Normal &&
             Capture(node->best) != Empty && Capture(node->best) != Pawn &&
             board.getMaterial(board.oppositeSide()).pieceCount() == 1 &&
             board.getMaterial(board.sideToMove()).pieceCount() <= 1) {
@@ -1146,7 +1391,7 @@ int depth, Move exclude [], int num_exclude)
     fail_high_root = 0;
     while (!node->cutoff && !terminate) {
         Move move;
-        if ((move = mg.nextMove(split,move_index))==NullMove) break;
+        if ((move = mg.nextMove(move_index))==NullMove) break;
         if (IsUsed(move)) {
            continue;     // skip move
         }
@@ -1292,8 +1537,8 @@ int depth, Move exclude [], int num_exclude)
     else if (!IsNull(node->best) && !CaptureOrPromotion(node->best) &&
              board.checkStatus() != InCheck) {
         context.setKiller((const Move)node->best, node->ply);
-        History::updateHistory(board, node, node->best, 0,
-                               board.sideToMove());
+        context.history.updateHistory(board, node, node->best, 0,
+                                      board.sideToMove());
     }
 #ifdef MOVE_ORDER_STATS
     if (node->num_try && node->best_score > node->alpha) {
@@ -1305,6 +1550,7 @@ int depth, Move exclude [], int num_exclude)
 #endif
     ASSERT(node->best_score >= -Constants::MATE && node->best_score <= Constants::MATE);
     controller->stats->num_nodes += nodeAccumulator;
+    nodeCount += nodeAccumulator;
     nodeAccumulator = 0;
     return node->best_score;
 }
@@ -1316,12 +1562,13 @@ int Search::quiesce(int ply,int depth)
    ASSERT(ply < Constants::MaxPly);
    if (++nodeAccumulator > NODE_ACCUM_THRESHOLD) {
       controller->stats->num_nodes += nodeAccumulator;
+      nodeCount += nodeAccumulator;
       nodeAccumulator = 0;
 #ifdef SMP_STATS
       --controller->sample_counter;
 #endif
       if (--controller->time_check_counter <= 0) {
-         controller->time_check_counter = Time_Check_Interval;
+         controller->time_check_counter = controller->time_check_interval;
          if (checkTime(board,ply)) {
             if (talkLevel == Trace) {
                cout << "# terminating, time up" << endl;
@@ -1379,16 +1626,11 @@ int Search::quiesce(int ply,int depth)
    // Note: we copy the hash entry .. so mods by another thread do not
    // alter the copy
    result = controller->hashTable.searchHash(board,hash,
-                                             ply,tt_depth,controller->age,hashEntry);
-#ifdef SEARCH_STATS
-   controller->stats->hash_searches++;
-#endif
+                                             ply,tt_depth,controller->age,hashEntry,
+                                             &hashStats);
    bool hit = (result != HashEntry::NoHit);
    if (hit) {
       // a valid hashtable entry was found
-#ifdef SEARCH_STATS
-      controller->stats->hash_hits++;
-#endif
       node->staticEval = hashEntry.staticValue();
       value = hashEntry.getValue();
       // If this is a mate score, adjust it to reflect the
@@ -1581,6 +1823,8 @@ int Search::quiesce(int ply,int depth)
    else {
       // not in check
       bool had_eval = false;
+      // false if the stand pat score is only a lazy eval bound
+      bool exact_eval = true;
       // Establish a default score.  This score is returned if no
       // captures are generated, or if no captures generate a better
       // score (since we generally can choose whether or not to capture).
@@ -1609,7 +1853,22 @@ int Search::quiesce(int ply,int depth)
 #endif
          }
          if (node->eval == Scoring::INVALID_SCORE) {
-            node->eval = node->staticEval = scoring.evalu8(board);
+            if (node->PV()) {
+               node->eval = node->staticEval = scoring.evalu8(board);
+            } else {
+               // Outside the PV, a bound is good enough for the stand
+               // pat and futility decisions if the score is far outside
+               // the window.
+               node->eval = scoring.evalu8(board,node->alpha,node->beta,exact_eval);
+               if (exact_eval) {
+                  node->staticEval = node->eval;
+               }
+#ifdef SEARCH_STATS
+               else {
+                  controller->stats->lazy_evals++;
+               }
+#endif
+            }
          }
          if (hit) {
             const int hashValue = hashEntry.getValue();
@@ -1651,14 +1910,16 @@ int Search::quiesce(int ply,int depth)
             }
             ASSERT(!board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove()));
             // store eval in hash table if not already fetched from there
-            if (!had_eval) {
+            // (a lazy eval bound is not a usable static eval)
+            if (!had_eval && exact_eval) {
                controller->hashTable.storeHash(hash, tt_depth,
                                                controller->age,
                                                HashEntry::Eval,
                                                node->best_score,
                                                node->staticEval,
                                                0,
-                                               node->best);
+                                               node->best,
+                                               &hashStats);
             }
             return node->eval;
          }
@@ -1783,6 +2044,9 @@ int Search::quiesce(int ply,int depth)
                }
             }
             node->last_move = move;
+#ifdef USE_PREFETCH
+            prefetchHash(controller->hashTable,board,move);
+#endif
             board.doMove(move);
             try_score = -quiesce(-node->beta, -node->best_score, ply+1, depth-1);
             board.undoMove(move,state);
@@ -1862,6 +2126,9 @@ int Search::quiesce(int ply,int depth)
                   continue;
                }
                node->last_move = move;
+#ifdef USE_PREFETCH
+               prefetchHash(controller->hashTable,board,move);
+#endif
                board.doMove(move);
                // verify opposite side in check:
                ASSERT(board.anyAttacks(board.kingSquare(board.sideToMove()),board.oppositeSide()));
@@ -1928,7 +2195,6 @@ int Search::quiesce(int ply,int depth)
 
 void RootSearch::clearHashTables() {
   Search::clearHashTables();
-  History::clearHistory();
   context.clearKiller();
   scoring.clearHashTables();
 }
@@ -2004,7 +2270,8 @@ void Search::storeHash(const Board &board, hash_t hash, Move hash_move, int dept
             node->best_score, node->staticEval,
             (IsForced(node->best) ? HashEntry::FORCED_MASK : 0) |
             (IsForced2(node->best) ? HashEntry::FORCED2_MASK : 0),
-            node->best);
+            node->best,
+            &hashStats);
     }
 }
 
@@ -2216,6 +2483,7 @@ int Search::search()
     ASSERT(ply < Constants::MaxPly);
     if (++nodeAccumulator > NODE_ACCUM_THRESHOLD) {
         controller->stats->num_nodes += nodeAccumulator;
+        nodeCount += nodeAccumulator;
         nodeAccumulator = 0;
 #if defined(SMP_STATS)
         // sample thread usage
@@ -2227,7 +2495,7 @@ int Search::search()
         }
 #endif
         if (--controller->time_check_counter <= 0) {
-            controller->time_check_counter = Time_Check_Interval;
+            controller->time_check_counter = controller->time_check_interval;
             if (checkTime(board,ply)) {
                if (talkLevel == Trace) {
                   cout << "# terminating, time up" << endl;
@@ -2278,15 +2546,9 @@ int Search::search()
     // Note: we copy the hash entry .. so mods by another thread do not
     // alter the copy
     result = controller->hashTable.searchHash(board,board.hashCode(rep_count),
-                              ply,depth,controller->age,hashEntry);
-#ifdef SEARCH_STATS
-    controller->stats->hash_searches++;
-#endif
+                              ply,depth,controller->age,hashEntry,&hashStats);
     bool hit = result != HashEntry::NoHit;
     if (hit) {
-#ifdef SEARCH_STATS
-        controller->stats->hash_hits++;
-#endif
          // always accept a full-depth entry (cached tb hit)
          if (!hashEntry.tb()) {
             // if using TBs at this ply, do not pull a non-TB entry out of
@@ -2359,8 +2621,8 @@ int Search::search()
                             " value = " << value << endl;
                     }
 #endif
-                    History::updateHistoryMove(board,hashEntry.bestMove(board),
-                                               node->depth, board.sideToMove());
+                    context.history.updateHistoryMove(board,hashEntry.bestMove(board),
+                                                      node->depth, board.sideToMove());
 
                     return value;                     // cutoff
                 }
@@ -2417,7 +2679,8 @@ int Search::search()
                 score,
                 Scoring::INVALID_SCORE,
                 HashEntry::TB_MASK,
-                NullMove);
+                NullMove,
+                &hashStats);
             node->best_score = tb_score;               // unadjusted score
             node->flags |= EXACT;
             return node->best_score;
@@ -2725,7 +2988,13 @@ int Search::search()
 #endif
               continue;
             }
+#ifdef USE_PREFETCH
+            prefetchHash(controller->hashTable,board,move);
+#endif
             board.doMove(move);
+#ifdef USE_PREFETCH
+            scoring.prefetchPawnEntry(board);
+#endif
             if (!in_check && !board.wasLegal(move)) {
                   ASSERT(board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove()));
 #ifdef _TRACE
@@ -2877,7 +3146,7 @@ int Search::search()
     if (!IsNull(node->best) && !CaptureOrPromotion(node->best) &&
         board.checkStatus() != InCheck) {
         context.setKiller((const Move)node->best, node->ply);
-        History::updateHistory(board,node,node->best,
+        context.history.updateHistory(board,node,node->best,
             depth,
             board.sideToMove());
     }
@@ -3018,6 +3287,112 @@ int Search::updateRootMove(const Board &board,
 
 // Perform search in a separate thread. We have always searched
 // at least one move before calling this.
+// Lazy SMP helpers skip some iterations, so that not all threads
+// search the same depth at the same time. These tables give the
+// length of the cycle and the starting phase for each helper.
+static const int LAZY_SKIP_SIZE[] =
+    {1,1,2,2,2,2,3,3,3,3,3,3,4,4,4,4,4,4,4,4};
+static const int LAZY_SKIP_PHASE[] =
+    {0,1,0,1,2,3,0,1,2,3,4,5,0,1,2,3,4,5,6,7};
+
+void Search::lazySearch(const Board &rootBoard)
+{
+    NodeStack stack;
+    board = rootBoard;
+    node = stack;
+    split = NULL;
+    activeSplitPoints = 0;
+    nodeAccumulator = 0;
+    context.clearKiller();
+    context.refutations.clearRefutations();
+    node->best = NullMove;
+    RootMoveGenerator mg(board,&context);
+    if (mg.moveCount() == 0) return;
+    const int cycle = (ti->index-1) % 20;
+    int value = 0;
+    for (int d = 1; d <= controller->ply_limit && !terminate; d++) {
+        if (d > 1 &&
+            ((d+LAZY_SKIP_PHASE[cycle])/LAZY_SKIP_SIZE[cycle]) % 2) {
+            continue;
+        }
+        int alpha = -Constants::MATE, beta = Constants::MATE;
+        if (d > 1) {
+            alpha = Util::Max(-Constants::MATE,value - ASPIRATION_WINDOW[0]/2);
+            beta = Util::Min(Constants::MATE,value + ASPIRATION_WINDOW[0]/2);
+        }
+        for (;;) {
+            int score = lazyRoot(mg,alpha,beta,d*DEPTH_INCREMENT);
+            if (terminate) break;
+            // on a fail, re-search with the window opened on that side
+            if (score <= alpha && alpha > -Constants::MATE) {
+                alpha = -Constants::MATE;
+            }
+            else if (score >= beta && beta < Constants::MATE) {
+                beta = Constants::MATE;
+            }
+            else {
+                value = score;
+                break;
+            }
+        }
+    }
+    controller->stats->num_nodes += nodeAccumulator;
+    nodeCount += nodeAccumulator;
+    nodeAccumulator = 0;
+}
+
+int Search::lazyRoot(RootMoveGenerator &mg, int alpha, int beta, int depth)
+{
+    BoardState save_state = board.state;
+    mg.reorder(node->best,depth/DEPTH_INCREMENT);
+    node->alpha = node->best_score = alpha;
+    node->beta = beta;
+    node->best = NullMove;
+    node->pv[0] = NullMove;
+    node->pv_length = 0;
+    node->cutoff = 0;
+    node->num_try = 0;
+    node->flags = 0;
+    node->ply = 0;
+    node->depth = depth;
+    node->eval = node->staticEval = Scoring::INVALID_SCORE;
+    node->threatMove = NullMove;
+    int move_index = 0;
+    Move move;
+    while (!terminate && (move = mg.nextMove(move_index)) != NullMove) {
+        node->last_move = move;
+        node->extensions = 0;
+        CheckStatusType in_check_after_move = board.wouldCheck(move);
+        int extend = calcExtensions(board,node,node,in_check_after_move,
+                                    move_index,move);
+        if (extend == PRUNE) continue;
+        board.doMove(move);
+        setCheckStatus(board,in_check_after_move);
+        node->done[node->num_try++] = move;
+        const int newDepth = depth+extend-DEPTH_INCREMENT;
+        const int lo = node->best_score;
+        // first move gets a full window, the rest a zero window
+        const int hi = node->num_try == 1 ? node->beta : lo+1;
+        int score = newDepth > 0 ? -search(-hi,-lo,1,newDepth) :
+            -quiesce(-hi,-lo,1,0);
+        if (!terminate && score > lo && hi < node->beta) {
+            // no cutoff, re-search with the full window and no reduction
+            node->extensions = 0;
+            const int fullDepth = Util::Max(extend,0)+depth-DEPTH_INCREMENT;
+            score = fullDepth > 0 ? -search(-node->beta,-lo,1,fullDepth) :
+                -quiesce(-node->beta,-lo,1,0);
+        }
+        board.undoMove(move,save_state);
+        if (terminate) break;
+        if (score > node->best_score) {
+            node->best_score = score;
+            node->best = move;
+            if (score >= node->beta) break;
+        }
+    }
+    return node->best_score;
+}
+
 void Search::searchSMP(ThreadInfo *ti)
 {
     Move move;
@@ -3036,11 +3411,12 @@ void Search::searchSMP(ThreadInfo *ti)
     MoveGenerator *mg = ti->work->split->mg;
     bool fhr = false;
     while (!parentNode->cutoff && !terminate) {
-        move = in_check ?
-           mg->nextEvasion(split,moveIndex) :
-           mg->nextMove(split,moveIndex);
+        move = split->nextMove(moveIndex);
         if (IsNull(move)) break;
         if (IsUsed(move)) continue;
+#ifdef SMP_STATS
+        const uint64 startNodes = nodeCount + nodeAccumulator;
+#endif
 #ifdef SEARCH_STATS
         ++controller->stats->moves_searched;
 #endif
@@ -3069,7 +3445,13 @@ void Search::searchSMP(ThreadInfo *ti)
 #endif
            continue;
         }
+#ifdef USE_PREFETCH
+        prefetchHash(controller->hashTable,board,move);
+#endif
         board.doMove(move);
+#ifdef USE_PREFETCH
+        scoring.prefetchPawnEntry(board);
+#endif
         if (!in_check && !board.wasLegal(move)) {
 #ifdef _TRACE
            if (master()) {
@@ -3115,13 +3497,20 @@ void Search::searchSMP(ThreadInfo *ti)
           if (master()) {
              indent(ply); cout << "parent node cutoff" << endl;
           }
+#endif
+#ifdef SMP_STATS
+           if (!terminate) {
+              // work on this move was wasted by a cutoff elsewhere
+              ti->stats.abortedMoves++;
+              ti->stats.abortedNodes += nodeCount + nodeAccumulator - startNodes;
+           }
 #endif
            board.undoMove(move,state);
            break;
         }
         // it is possible the parent node's best score has changed, so
         // compare against that
-        split->lock();
+        LockTimed(split->mylock,ti->stats.splitLock);
         if (try_score > parentNode->best_score &&
             (parentNode->beta > best_score+1 || extend < 0) &&
             !((node+1)->flags & EXACT) &&
@@ -3180,7 +3569,7 @@ void Search::searchSMP(ThreadInfo *ti)
         }
 #endif
         if (!terminate && !parentNode->cutoff) {
-            split->lock();
+            LockTimed(split->mylock,ti->stats.splitLock);
             ASSERT(parentNode->num_try<Constants::MaxMoves);
             parentNode->done[parentNode->num_try++] = move;
             split->unlock();
@@ -3240,7 +3629,7 @@ int Search::updateMove(const Board &board, NodeInfo *parentNode, NodeInfo *node,
 #ifdef MOVE_ORDER_STATS
        parentNode->best_count = parentNode->num_try-1;
 #endif
-       Refutations::setRefutation((parentNode-1)->last_move,move);
+       context.refutations.setRefutation((parentNode-1)->last_move,move);
        if (score >= parentNode->beta) {
 #ifdef _TRACE
            if (master()) {
@@ -3323,7 +3712,8 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
     // Now that we have searched at least one valid move, we can
     // consider using multiple threads to search the rest (YBWC).
     int splits = 0;
-    if (!terminate && mg->more() &&
+    uint64 splitStart = 0;
+    if (!terminate && !srcOpts.lazy_smp && mg->more() &&
         activeSplitPoints < SPLIT_STACK_MAX_DEPTH &&
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS)
         (!srcOpts.use_tablebases ||
@@ -3341,6 +3731,10 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
             // A thread is available.
             ASSERT(slave_ti != ti);
             if (!splits) {
+               splitStart = getCurrentNanos();
+#ifdef SMP_STATS
+               ti->stats.splits++;
+#endif
                // Save the current split point if any (may be NULL)
                SplitPoint *parent = split;
                // We are about the change the parent's stack, so lock it
@@ -3361,21 +3755,21 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
                split->mg = mg;
                split->splitNode = node;
                // save master's current state
-               split->savedBoard = board;
+               split->savedBoard.copyForSplit(board);
 #ifndef _WIN32
                // ensure parent thread will wait when back in idle loop
                ti->reset();
 #endif
-               Unlock(splitLock);
                // Force all remaining moves to be generated, since the
                // MoveGenerator class is not thread-safe otherwise (it
                // maintains a pointer to the board and when accessed by
                // multiple threads this pointer may not always be at the
                // current position). Also we want to know how many moves
                // remain.
+               Unlock(splitLock);
                remaining = mg->generateAllMoves(node,split);
             }
-            split->lock();
+            LockTimed(split->mylock,ti->stats.splitLock);
             ASSERT(slave_ti != ti);
             // Add new slave to the list of slaves in the parent split point
             split->slaves.add(slave_ti);
@@ -3389,9 +3783,6 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
             log("adding slave thread ", slave_ti->index);
 #endif
             slaves[splits++] = slave_ti;
-#ifdef SMP_STATS
-            controller->stats->splits++;
-#endif
 #ifdef _THREAD_TRACE
             log("split ply",ply);
             log("depth",depth);
@@ -3405,6 +3796,19 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
             slaves[i]->start();
         }
         Unlock(splitLock);
+        if (splits) {
+            // Other masters may be updating these at the same time.
+            const uint64 splitTime = getCurrentNanos() - splitStart;
+#ifdef AtomicAdd64
+            AtomicAdd64(controller->stats->splits,splits);
+            AtomicAdd64(controller->stats->split_time,splitTime);
+#else
+            Lock(controller->split_calc_lock);
+            controller->stats->splits += splits;
+            controller->stats->split_time += splitTime;
+            Unlock(controller->split_calc_lock);
+#endif
+        }
     }
     if (splits) {
         ASSERT(activeSplitPoints);
@@ -3419,7 +3823,7 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
         // Important to lock here - otherwise there is a race condition with
         // ThreadPool::checkIn.
         Lock(splitLock);
-        split->lock();
+        LockTimed(split->mylock,ti->stats.splitLock);
 #ifdef _THREAD_TRACE
         {
             ostringstream os;
@@ -3497,7 +3901,7 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
 void Search::init(NodeStack &ns, ThreadInfo *slave_ti) {
     SplitPoint *s = split;
     // copy in new state
-    board = s->savedBoard;
+    board.copyForSplit(s->savedBoard);
     node = ns+s->ply;
     // The split variable holds the split point to which this Search
     // instance is attached
@@ -3519,14 +3923,28 @@ void Search::init(NodeStack &ns, ThreadInfo *slave_ti) {
     // clear killer since the side to move may have been different
     // in the previous use of this class.
     context.clearKiller();
+    // Start from the root search's history and refutation tables as
+    // of the start of this iteration. They are copied only at the
+    // first split point this instance joins in the iteration: after
+    // that it keeps what it has learned itself.
+    if (snapshotId != controller->snapshotId) {
+        Lock(controller->snapshot_lock);
+        context.history = controller->historySnapshot;
+        context.refutations = controller->refutationsSnapshot;
+        snapshotId = controller->snapshotId;
+        Unlock(controller->snapshot_lock);
+    }
 }
 
 void Search::clearHashTables() {
    scoring.clearHashTables();
+   context.history.clearHistory();
 }
 
 void Search::setSearchOptions() {
-   srcOpts = options.search;
+   srcOpts = controller->srcOpts;
+   scoring.setStrength(srcOpts.strength);
+   scoring.setPawnHashSize(srcOpts.pawn_hash_size);
 }
 
 
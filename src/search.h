@@ -23,7 +23,13 @@ struct NodeInfo;
 // Definition of a split point
 struct SplitPoint {
     ArasanSet<ThreadInfo *,Constants::MaxCPUs> slaves;
+    // Moves remaining to be searched, all generated when the split
+    // point is created. Threads take them in order via nextMove().
     Move moves[Constants::MaxMoves];
+    int moveCount;
+    volatile int moveIndex;
+    // move order (as returned by MoveGenerator) of moves[0]
+    int orderBase;
     int ply;
     int depth;
     // Thread that is master of the split point
@@ -51,6 +57,20 @@ struct SplitPoint {
     void unlock() {
         Unlock(mylock);
     }
+    // Get the next move to search, or NullMove if none are left.
+    // "order" is set to the move's order in the move generator.
+    Move nextMove(int &order) {
+#ifdef AtomicFetchAdd
+        const int i = AtomicFetchAdd(moveIndex,1);
+#else
+        lock();
+        const int i = moveIndex++;
+        unlock();
+#endif
+        if (i >= moveCount) return NullMove;
+        order = orderBase + i;
+        return moves[i];
+    }
 };
 #define SPLIT_STACK_MAX_DEPTH 4
 
@@ -109,10 +129,19 @@ typedef int (CDECL *TerminateFunction)(const Statistics &);
 class SearchController {
   friend class Search;
   friend class RootSearch;
+  friend class ThreadPool;
 
  public:
+   // Each instance has its own thread pool, hash table and search
+   // state, so several may search at once in one process. The
+   // search and learning options are copied from the global
+   // options, or from opts and learnOpts.
    SearchController();
 
+   explicit SearchController(const Options::SearchOptions &opts,
+                             const Options::LearningOptions &learnOpts =
+                             Options::LearningOptions());
+
    ~SearchController();
 
    Move findBestMove(
@@ -164,14 +193,38 @@ class SearchController {
 
     void clearHashTables();
 
+    // Change the hash table size, keeping existing entries where
+    // possible.
     void resizeHash(size_t newSize);
 
+    // Hash clearing runs in the background on the thread pool. This
+    // waits for it to complete.
+    void waitForHashClear();
+
+    // save or load the hash table contents (0 if successful)
+    int saveHash(const string &fileName);
+
+    int loadHash(const string &fileName);
+
+    // Totals of the per-thread hash table statistics.
+    void getHashStats(HashStats &stats) const;
+
+    void clearHashStats();
+
     void stopAllThreads();
 
+    // stop the Lazy SMP helper threads, but not the root search
+    void stopHelpers();
+
     void clearStopFlags();
      
+    // Set this instance's search options (and, for the first form,
+    // learning options) from the global options, or from opts, and
+    // apply them to the search threads.
     void updateSearchOptions();
 
+    void updateSearchOptions(const Options::SearchOptions &opts);
+
     void setBackground(int b) {
       background = b;
     }
@@ -191,6 +244,13 @@ class SearchController {
 
     int getIterationDepth() const;
 
+#ifdef SMP_STATS
+    // per-thread statistics for the last search
+    void printSmpStats(ostream &out) const {
+        pool->printStats(out);
+    }
+#endif
+
     RootSearch *root() const {
       return rootSearch;
     }
@@ -252,11 +312,27 @@ class SearchController {
     bool stopped;
     SearchType typeOfSearch;
     int time_check_counter;
+    // number of node count updates between time checks
+    int time_check_interval;
+    // time of the last periodic UCI info output
+    CLOCK_TYPE last_info_time;
     int failLowFactor;
 #ifdef SMP_STATS
     int sample_counter;
 #endif
+    // this instance's copy of the search options
+    Options::SearchOptions srcOpts;
+    // and of the learning options
+    Options::LearningOptions learnOpts;
     int threadSplitDepth;
+    // State of the split depth controller (see adjustSplitDepth):
+    // start of the current measurement interval and the counts at
+    // that time, samples of the number of active threads, and the
+    // smoothed idle fraction and split overhead.
+    CLOCK_TYPE splitSampleTime;
+    uint64 splitSampleNodes, splitSampleSplits, splitSampleCost;
+    unsigned splitActiveSamples, splitActiveSum;
+    double idleAvg, splitOverheadAvg;
     Statistics *stats;
     ColorType computerSide;
     int ratingDiff, ratingFactor;
@@ -264,7 +340,31 @@ class SearchController {
     RootSearch *rootSearch;
     ThreadPool *pool;
     bool active;
+    bool hashClearPending;
     LockDefine(split_calc_lock);
+    // Copy of the root search's history and refutation tables, taken
+    // at the start of each iteration, from which slaves start. Its id
+    // is incremented with each copy. Protected by snapshot_lock.
+    History historySnapshot;
+    Refutations refutationsSnapshot;
+    volatile unsigned snapshotId;
+    LockDefine(snapshot_lock);
+
+    // save the root search's tables as the new snapshot
+    void saveSnapshot(Search *);
+
+    // common part of the constructors
+    void init(const Options::SearchOptions &opts);
+
+    // Adjust the split depth from measured thread idle time and
+    // split overhead. Called periodically during the search.
+    void adjustSplitDepth(CLOCK_TYPE current_time);
+
+    // start clearing the hash table in the background
+    void startHashClear();
+
+    // pool task that runs a Lazy SMP helper search
+    static void lazyHelper(void *arg, ThreadInfo *ti, unsigned, unsigned);
 };
 
 class Search : public ThreadControl {
@@ -310,6 +410,9 @@ class Search : public ThreadControl {
     void searchSMP(ThreadInfo *);
     int maybeSplit(const Board &board, NodeInfo *node,
                    MoveGenerator *mg, int ply, int depth);
+    // Lazy SMP: run an independent iterative deepening search from
+    // the root position, sharing results only via the hash table.
+    void lazySearch(const Board &rootBoard);
     void stop() {
         terminate = 1;
     }
@@ -325,7 +428,7 @@ class Search : public ThreadControl {
             // Restore state from prior split point. We are not quite
             // out of the search routine from which the split occurred,
             // so may still need to touch these variables before exiting.
-            board = split->savedBoard;
+            board.copyForSplit(split->savedBoard);
             node = split->splitNode;
         }
     }
@@ -351,6 +454,9 @@ class Search : public ThreadControl {
 
     int movesRelated( Move lastMove, Move threatMove) const;
 
+    // search all root moves for a Lazy SMP helper thread
+    int lazyRoot(RootMoveGenerator &mg, int alpha, int beta, int depth);
+
     int calcExtensions(const Board &board,
                        NodeInfo *node, NodeInfo *parentNode,
                        CheckStatusType in_check_after_move,
@@ -433,6 +539,9 @@ class Search : public ThreadControl {
     SearchController *controller;
     Board board;
     SearchContext context;
+    // id of the controller's snapshot that the history and refutation
+    // tables were last copied from
+    unsigned snapshotId;
     int terminate;
     uint64 nodeCount;
     int nodeAccumulator;
@@ -445,6 +554,7 @@ class Search : public ThreadControl {
     // All slave nodes and the parent share a split point instance.
     SplitPoint *split; 
     Scoring scoring;
+    HashStats hashStats;
     ThreadInfo *ti; // thread now running this search
     int threadSplitDepth;
     // The following variables are maintained as local copies of 
@@ -5,6 +5,8 @@
 
 #include "constant.h"
 #include "chess.h"
+#include "history.h"
+#include "refut.h"
 
 struct NodeInfo;
 class Board;
@@ -20,6 +22,9 @@ class SearchContext {
     Move Killers1[Constants::MaxPly];
     Move Killers2[Constants::MaxPly];
 
+    History history;
+    Refutations refutations;
+
 };
 
 
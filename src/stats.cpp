@@ -27,11 +27,12 @@ void Statistics::clear()
    failhigh = faillow = 0;
    depth = 0;
    num_nodes = (uint64)0;
+   splits = split_time = (uint64)0;
    display_value = Scoring::INVALID_SCORE;
 #ifdef SEARCH_STATS
    num_qnodes = reg_nodes = moves_searched = static_null_pruning =
-       razored = (uint64)0;
-   hash_hits = hash_searches = futility_pruning = null_cuts = lmp = (uint64)0;
+       razored = lazy_evals = (uint64)0;
+   futility_pruning = null_cuts = lmp = (uint64)0;
    history_pruning = lmp = see_pruning = (uint64)0;
    check_extensions = capture_extensions =
      pawn_extensions = evasion_extensions = 0L;
@@ -44,9 +45,8 @@ void Statistics::clear()
    for (i = 0; i < 4; i++) move_order[i]=0;
 #endif
 #ifdef SMP_STATS
-   splits = samples = threads = 0L;
-   last_split_sample = 0ULL;
-   last_split_time = getCurrentTime();
+   samples = threads = 0L;
+   wakeups = wake_latency = 0L;
 #endif
 #ifdef TUNE
    target = target_out_window = 0.0;
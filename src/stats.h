@@ -34,6 +34,7 @@ struct Statistics
    uint64 tb_hits;   // tablebase hits
 #ifdef SEARCH_STATS
    uint64 num_qnodes;
+   uint64 lazy_evals; // qsearch stand pat scores from lazy eval
    uint64 reg_nodes;
    uint64 moves_searched; // in regular search
    uint64 futility_pruning;
@@ -46,14 +47,16 @@ struct Statistics
    uint64 lmp;
    uint64 history_pruning;
    uint64 see_pruning;
-   uint64 hash_hits, hash_searches;
 #endif
    uint64 num_nodes;
    uint64 splits;
-   uint64 last_split_sample;
-   uint64 last_split_time;
+   // total time spent setting up split points, in nanoseconds
+   uint64 split_time;
 #ifdef SMP_STATS
    uint64 samples, threads;
+   // number of slave threads started at split points, and their
+   // total wakeup latency in microseconds
+   uint64 wakeups, wake_latency;
 #endif
 #ifdef MOVE_ORDER_STATS
    int move_order[4];
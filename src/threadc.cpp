@@ -79,7 +79,24 @@ void ThreadControl::reset() {
 #endif
 }
 
-int ThreadControl::wait() {
+int ThreadControl::wait(unsigned spin) {
+   if (spin) {
+      const uint64 end = getCurrentMicros() + spin;
+      for (unsigned i = 1; ; i++) {
+#ifdef _WIN32
+         if (WaitForSingleObject(hEvent1,0) == WAIT_OBJECT_0) {
+            // signalled, and the event is now reset
+            return 0;
+         }
+#else
+         if (state) break; // lock and reset below
+#endif
+         CpuPause();
+         // the clock is relatively expensive, so do not read it
+         // on every iteration
+         if (i % 64 == 0 && getCurrentMicros() >= end) break;
+      }
+   }
 #ifdef _WIN32
    return (WaitForSingleObject(hEvent1,INFINITE) != WAIT_OBJECT_0);
 #else
@@ -10,8 +10,11 @@ class ThreadControl {
    ThreadControl();
    virtual ~ThreadControl();
 
-   // wait for signal; return 1 if interrupted
-   int wait();
+   // wait for signal; return 1 if interrupted. If spin is non-zero,
+   // poll for the signal for up to that many microseconds before
+   // blocking, which avoids the cost of a wakeup by the OS if the
+   // signal comes soon.
+   int wait(unsigned spin = 0);
    // return non-zero if caller would wait (but don't actually wait)
    int wouldWait();
    // wait for a fixed time interval (in milliseconds)
@@ -27,7 +30,7 @@ class ThreadControl {
 #else
    pthread_mutex_t mutex;
    pthread_cond_t cond;
-   unsigned state;
+   volatile unsigned state;
 #endif
 
 };
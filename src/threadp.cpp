@@ -7,16 +7,113 @@
 #include <errno.h>
 #include <fcntl.h>
 #endif
-
-lock_t ThreadPool::poolLock;
-
-uint64 ThreadPool::activeMask = 0ULL;
-uint64 ThreadPool::availableMask = 0ULL;
+#ifdef __linux__
+#include <sched.h>
+#include <fstream>
+#endif
+#include <algorithm>
+#include <iomanip>
+#include <map>
 
 #ifndef _WIN32
 static const size_t THREAD_STACK_SIZE = 8*1024*1024;
 #endif
 
+struct CpuInfo {
+   int cpu, package, core;
+   // rank of the CPU among the hyperthreads of its core, and of its
+   // core among the cores of its package
+   int smt, coreRank;
+};
+
+// hyperthreads of a core together, cores of a package together
+static bool compactOrder(const CpuInfo &a, const CpuInfo &b) {
+   if (a.package != b.package) return a.package < b.package;
+   if (a.core != b.core) return a.core < b.core;
+   return a.cpu < b.cpu;
+}
+
+// one hyperthread per core first, alternating between packages
+static bool scatterOrder(const CpuInfo &a, const CpuInfo &b) {
+   if (a.smt != b.smt) return a.smt < b.smt;
+   if (a.coreRank != b.coreRank) return a.coreRank < b.coreRank;
+   if (a.package != b.package) return a.package < b.package;
+   return a.cpu < b.cpu;
+}
+
+// CPUs the process may run on, saved before any thread is pinned
+#ifdef __linux__
+static cpu_set_t processCpus;
+#elif defined(_WIN32)
+static DWORD_PTR processCpus;
+#endif
+static bool processCpusSaved = false;
+
+// Number of pool threads pinned to each CPU, over all thread pools in
+// the process, so that concurrent pools are given disjoint CPUs while
+// there are enough of them. Protected by cpu_lock.
+static map<int,unsigned> cpuUse;
+static lock_t cpu_lock;
+
+#ifdef __linux__
+static int readTopology(int cpu, const char *item) {
+   stringstream path;
+   path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/" << item;
+   ifstream in(path.str().c_str());
+   int value = 0;
+   if (!(in >> value)) value = 0;
+   return value;
+}
+#endif
+
+// Get the CPUs we are allowed to run on, with their package and
+// core ids. Returns an empty list if this is not supported.
+static void getCpus(vector<CpuInfo> &cpus)
+{
+#ifdef __linux__
+   if (!processCpusSaved) return;
+   for (int i = 0; i < CPU_SETSIZE; i++) {
+      if (CPU_ISSET(i,&processCpus)) {
+         CpuInfo c;
+         c.cpu = i;
+         c.package = readTopology(i,"physical_package_id");
+         c.core = readTopology(i,"core_id");
+         c.smt = c.coreRank = 0;
+         cpus.push_back(c);
+      }
+   }
+#elif defined(_WIN32)
+   if (!processCpusSaved) return;
+   DWORD len = 0;
+   GetLogicalProcessorInformation(NULL,&len);
+   vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(len/sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+   if (info.empty() || !GetLogicalProcessorInformation(&info[0],&len)) {
+      info.clear();
+   }
+   for (int i = 0; i < (int)(8*sizeof(DWORD_PTR)); i++) {
+      const DWORD_PTR bit = ((DWORD_PTR)1) << i;
+      if (processCpus & bit) {
+         CpuInfo c;
+         c.cpu = i;
+         c.package = c.core = 0;
+         c.smt = c.coreRank = 0;
+         int cores = 0, packages = 0;
+         for (size_t j = 0; j < info.size(); j++) {
+            if (info[j].Relationship == RelationProcessorCore) {
+               if (info[j].ProcessorMask & bit) c.core = cores;
+               cores++;
+            }
+            else if (info[j].Relationship == RelationProcessorPackage) {
+               if (info[j].ProcessorMask & bit) c.package = packages;
+               packages++;
+            }
+         }
+         cpus.push_back(c);
+      }
+   }
+#endif
+}
+
 #ifdef _THREAD_TRACE
 static lock_t io_lock;
 
@@ -36,6 +133,7 @@ void log(const string &s,int param) {
 #endif
 
 void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
+   ThreadPool *pool = ti->pool;
    while (ti->state != ThreadInfo::Terminating) {
 #ifdef _THREAD_TRACE
       {
@@ -44,15 +142,21 @@ void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
       log(s.str());
       }
 #endif
-      Lock(poolLock);
+      LockTimed(pool->poolLock,ti->stats.poolLock);
       if (ti->wouldWait()) {
         ti->state = ThreadInfo::Idle; // mark thread available again
-        activeMask &= ~(1ULL << ti->index);
-        Unlock(poolLock);
-        int result;
-        if ((result = ti->wait()) != 0) {
-            if (result == -1) continue; // was interrupted
-            else break;
+        pool->setIdle(ti->index);
+        Unlock(pool->poolLock);
+#ifdef SMP_STATS
+        ti->waitStart = getCurrentMicros();
+#endif
+        int result = ti->wait(pool->spinTime());
+#ifdef SMP_STATS
+        pool->endWait(ti);
+#endif
+        if (result != 0) {
+          if (result == -1) continue; // was interrupted
+          else break;
         }
       } else {
 #ifdef _THREAD_TRACE
@@ -65,7 +169,7 @@ void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
 #endif
         // Avoid waiting if the thread state is already signalled. Also,
         // in this case, do not even temporarily set the state to Idle.
-        Unlock(poolLock);
+        Unlock(pool->poolLock);
       }
 #ifdef _THREAD_TRACE
       log("unblocked",ti->index);
@@ -79,6 +183,24 @@ void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
       if (ti->state == ThreadInfo::Terminating) {
           break;
       }
+      else if (ti->task) {
+          // run a task outside of search
+          ti->task(ti->taskArg,ti,ti->taskSlice,ti->taskSlices);
+          ti->task = NULL;
+          LockTimed(pool->poolLock,ti->stats.poolLock);
+          // ensure we will wait when back at the top of the loop
+          ti->reset();
+          // Mark the thread available before the task is counted as
+          // done, so that a task started right after this one can
+          // use it.
+          ti->state = ThreadInfo::Idle;
+          pool->setIdle(ti->index);
+          if (--pool->pendingTasks == 0) {
+              pool->taskDone.signal();
+          }
+          Unlock(pool->poolLock);
+          continue;
+      }
       else if (split && split->master == ti) {
           // This thread is master of a split point, test for condition #2
           Lock(split->master->work->splitLock);
@@ -114,6 +236,24 @@ void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
 #endif
       // child should have its split point set
       ASSERT(ti->work->split);
+#ifdef SMP_STATS
+      {
+          // record how long it took this thread to get going
+          // after being assigned to the split point
+          const uint64 now = getCurrentMicros();
+          if (ti->checkOutTime) {
+              ti->stats.startupTime += now - ti->checkOutTime;
+              ti->stats.startups++;
+              ti->checkOutTime = 0;
+          }
+          if (ti->signalTime) {
+              ti->stats.wakeLatency += now - ti->signalTime;
+              ti->stats.wakeups++;
+              ti->signalTime = 0;
+          }
+          ti->stats.joins++;
+      }
+#endif
       NodeStack childStack; // stack on which child will search
       ti->work->init(childStack, ti);
 #ifdef _THREAD_TRACE
@@ -134,7 +274,7 @@ void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
 #ifdef _THREAD_TRACE
       log("search completed ",ti->index);
 #endif
-      ti->pool->checkIn(ti);
+      pool->checkIn(ti);
    }
 }
 
@@ -146,9 +286,13 @@ static void * CDECL parkingLot(void *x)
 {
    ThreadInfo *ti = (ThreadInfo*)x;
    if (ti->index) {
-      ti->work = new Search(ti->pool->getController(),ti);
+      // Pin the thread first, so that the memory for its Search
+      // instance is allocated (and first touched) on its own node.
+      ti->pool->bindThread(ti);
+      ti->pool->attachSearch(ti,new Search(ti->pool->getController(),ti));
    }
    ThreadPool::idle_loop(ti);
+   if (ti->index) ti->pool->unbindThread(ti);
    // Free Search instance
    delete ti->work;
    ti->work = NULL;
@@ -165,6 +309,9 @@ void ThreadInfo::start() {
     ASSERT(index>=0);
 #ifdef _THREAD_TRACE
     log("start",index);
+#endif
+#ifdef SMP_STATS
+    signalTime = getCurrentMicros();
 #endif
     signal();
 }
@@ -178,7 +325,17 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
    work(NULL),
 #endif
    pool(p),
-   index(i)
+   index(i),
+   cpu(-1),
+   task(NULL),
+   taskArg(NULL),
+   taskSlice(0),
+   taskSlices(0)
+#ifdef SMP_STATS
+   , checkOutTime(0),
+   signalTime(0),
+   waitStart(0)
+#endif
 {
 #ifdef _THREAD_TRACE
   log("starting",i);
@@ -206,6 +363,7 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
 }
 
  ThreadPool::ThreadPool(SearchController *ctrl, int n) :
+    pendingTasks(0),
     controller(ctrl) {
 #ifndef _WIN32
    if (pthread_attr_init (&stackSizeAttrib)) {
@@ -222,15 +380,39 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
          perror("error setting thread stack size");
       }
    }
-#endif
-#ifdef _THREAD_TRACE
-  LockInit(io_lock);
 #endif
    LockInit(poolLock);
+   setAffinity(controller->srcOpts.thread_affinity);
+   vector<CpuInfo> cpus;
+   getCpus(cpus);
+#ifdef _WIN32
+   if (cpus.empty()) {
+      SYSTEM_INFO sysInfo;
+      GetSystemInfo(&sysInfo);
+      availableCpus = sysInfo.dwNumberOfProcessors;
+   }
+#else
+   if (cpus.empty()) {
+      availableCpus = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+   }
+#endif
+   else {
+      availableCpus = (unsigned)cpus.size();
+   }
+   memset(activeMask,'\0',sizeof(activeMask));
+   activeThreads = 0;
+#ifdef SMP_STATS
+   statsStart = getCurrentMicros();
+   statsEnd = 0;
+#endif
+   // Hold the lock until the thread table is filled in, since new
+   // threads may be given work (see runTask) as soon as they start.
+   Lock(poolLock);
    nThreads = n;
    for (int i = 0; i < n; i++) {
       ThreadInfo *p = new ThreadInfo(this,i);
       if (i==0) {
+         // thread 0 is the caller's thread, which is not pinned
          p->work = new RootSearch(controller,p);
          p->work->ti = p;
       }
@@ -240,16 +422,13 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
       }
       data[i] = p;
    }
-   activeMask = 1ULL;
-   availableMask = (n == 64) ? 0xffffffffffffffffULL :
-      (1ULL << n)-1;
+   setActive(0);
+   Unlock(poolLock);
 }
 
 ThreadPool::~ThreadPool() {
     shutDown();
-#ifdef _THREAD_TRACE
-  LockDestroy(io_lock);
-#endif
+    LockDestroy(poolLock);
 #ifndef _WIN32
   if (pthread_attr_destroy(&stackSizeAttrib)) {
      perror("pthread_attr_destroy");
@@ -290,33 +469,42 @@ void ThreadPool::shutDown() {
 ThreadInfo * ThreadPool::checkOut(Search *parent, NodeInfo *forNode,
   int ply, int depth) {
     // lock against changes to the pool
-    Lock(poolLock);
+    LockTimed(poolLock,parent->ti->stats.poolLock);
     // and aginst changes to the split stack in the parent
     Lock(parent->splitLock);
     // only loop over available threads
-    Bitboard b(~activeMask & availableMask);
-    b.clear(parent->ti->index);
-    int i;
-    while (b.iterate(i)) {
-       ThreadInfo *p = data[i];
-       ASSERT(p->state == ThreadInfo::Idle);
-       // If this is a "master" thread it is not sufficient to just be
-       // idle - assign it only to one of its slave threads at the
-       // current top of the search stack.
-       Search *child = p->work;
-       // lock the split stack in the child for the following test
-       Lock(child->splitLock);
-       if (!child->activeSplitPoints /* not master of a split point */ ||
-           child->splitStack[child->activeSplitPoints-1].slaves.exists(parent->ti)) {
-         // We're working now - ensure we will not be allocated again
-         p->state = ThreadInfo::Working; 
-         activeMask |= (1ULL << p->index);
-         Unlock(child->splitLock);
-         Unlock(parent->splitLock);
-         Unlock(poolLock);
-         return p;
+    for (unsigned w = 0; w*64 < nThreads; w++) {
+       const unsigned limit = nThreads - w*64;
+       Bitboard b(~activeMask[w] &
+                  (limit >= 64 ? 0xffffffffffffffffULL : (1ULL << limit)-1));
+       if ((unsigned)parent->ti->index/64 == w) {
+          b.clear(parent->ti->index % 64);
+       }
+       int i;
+       while (b.iterate(i)) {
+          ThreadInfo *p = data[w*64+i];
+          ASSERT(p->state == ThreadInfo::Idle);
+          // If this is a "master" thread it is not sufficient to just be
+          // idle - assign it only to one of its slave threads at the
+          // current top of the search stack.
+          Search *child = p->work;
+          // lock the split stack in the child for the following test
+          Lock(child->splitLock);
+          if (!child->activeSplitPoints /* not master of a split point */ ||
+              child->splitStack[child->activeSplitPoints-1].slaves.exists(parent->ti)) {
+            // We're working now - ensure we will not be allocated again
+            p->state = ThreadInfo::Working; 
+            setActive(p->index);
+#ifdef SMP_STATS
+            p->checkOutTime = getCurrentMicros();
+#endif
+            Unlock(child->splitLock);
+            Unlock(parent->splitLock);
+            Unlock(poolLock);
+            return p;
+          }
+          Unlock(child->splitLock);
        }
-       Unlock(child->splitLock);
     }
     // no luck, no free threads
     Unlock(parent->splitLock);
@@ -324,8 +512,153 @@ ThreadInfo * ThreadPool::checkOut(Search *parent, NodeInfo *forNode,
     return NULL;
 }
 
+unsigned ThreadPool::spinTime() const {
+    if (nThreads > availableCpus || controller->srcOpts.spin_wait <= 0) {
+        return 0;
+    }
+    return (unsigned)controller->srcOpts.spin_wait;
+}
+
+#ifdef SMP_STATS
+void ThreadStats::LockStats::add(uint64 nanos) {
+    waits++;
+    time += nanos;
+    int bucket = 0;
+    for (uint64 limit = 256; nanos >= limit && bucket < HISTOGRAM_SIZE-1;
+         limit *= 2) {
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+void ThreadStats::LockStats::add(const LockStats &s) {
+    waits += s.waits;
+    time += s.time;
+    for (int i = 0; i < HISTOGRAM_SIZE; i++) {
+        histogram[i] += s.histogram[i];
+    }
+}
+
+void ThreadPool::clearStats() {
+    Lock(poolLock);
+    statsStart = getCurrentMicros();
+    statsEnd = 0;
+    for (unsigned i = 0; i < nThreads; i++) {
+        data[i]->stats.clear();
+        if (data[i]->work) data[i]->work->nodeCount = 0;
+    }
+    Unlock(poolLock);
+}
+
+void ThreadPool::endStats() {
+    statsEnd = getCurrentMicros();
+}
+
+uint64 ThreadPool::statsInterval(uint64 start, uint64 end) const {
+    if (statsEnd && end > statsEnd) end = statsEnd;
+    if (start < statsStart) start = statsStart;
+    return end > start ? end - start : 0;
+}
+
+void ThreadPool::endWait(ThreadInfo *ti) {
+    ti->stats.idleTime += statsInterval(ti->waitStart,getCurrentMicros());
+    ti->waitStart = 0;
+}
+
+void ThreadPool::getWakeStats(uint64 &wakeups, uint64 &latency) const {
+    wakeups = latency = 0;
+    for (unsigned i = 0; i < nThreads; i++) {
+        wakeups += data[i]->stats.wakeups;
+        latency += data[i]->stats.wakeLatency;
+    }
+}
+
+static void printAverage(ostream &out, uint64 total, uint64 count) {
+    out << setw(9);
+    if (count) {
+        out << (float)total/(float)count;
+    } else {
+        out << '-';
+    }
+}
+
+void ThreadPool::printStats(ostream &out) const {
+    const uint64 now = getCurrentMicros();
+    const uint64 elapsed = (statsEnd ? statsEnd : now) - statsStart;
+    ios_base::fmtflags flags = out.flags();
+    streamsize prec = out.precision();
+    out << fixed << setprecision(1);
+    out << "thread     nodes  busy%  splits   joins  startup   wakeup" <<
+        "  aborted    aborted      split lock       pool lock" << endl;
+    out << "                                          (usec)   (usec)" <<
+        "    moves      nodes  waits   (usec)  waits   (usec)" << endl;
+    ThreadStats totals;
+    totals.clear();
+    uint64 totalNodes = 0;
+    for (unsigned i = 0; i < nThreads; i++) {
+        const ThreadInfo *p = data[i];
+        const ThreadStats &s = p->stats;
+        // include a wait that is still in progress
+        uint64 idle = s.idleTime;
+        if (p->waitStart) idle += statsInterval(p->waitStart,now);
+        out << setw(6) << i << setw(10) << (p->work ? p->work->nodeCount : 0) <<
+            setw(7) << (elapsed ? 100.0*(elapsed-std::min(idle,elapsed))/elapsed : 0.0) <<
+            setw(8) << s.splits << setw(8) << s.joins;
+        printAverage(out,s.startupTime,s.startups);
+        printAverage(out,s.wakeLatency,s.wakeups);
+        out << setw(9) << s.abortedMoves << setw(11) << s.abortedNodes <<
+            setw(7) << s.splitLock.waits << setw(9) << s.splitLock.time/1000 <<
+            setw(7) << s.poolLock.waits << setw(9) << s.poolLock.time/1000 << endl;
+        totalNodes += p->work ? p->work->nodeCount : 0;
+        totals.splits += s.splits;
+        totals.joins += s.joins;
+        totals.abortedMoves += s.abortedMoves;
+        totals.abortedNodes += s.abortedNodes;
+        totals.splitLock.add(s.splitLock);
+        totals.poolLock.add(s.poolLock);
+    }
+    out << " total" << setw(10) << totalNodes << setw(7) << ' ' <<
+        setw(8) << totals.splits << setw(8) << totals.joins <<
+        setw(9) << ' ' << setw(9) << ' ' <<
+        setw(9) << totals.abortedMoves << setw(11) << totals.abortedNodes <<
+        setw(7) << totals.splitLock.waits << setw(9) << totals.splitLock.time/1000 <<
+        setw(7) << totals.poolLock.waits << setw(9) << totals.poolLock.time/1000 << endl;
+    out << "lock wait histogram (ns, upper bound of each bucket):" << endl;
+    out << "           ";
+    for (int i = 0; i < ThreadStats::LockStats::HISTOGRAM_SIZE; i++) {
+        out << setw(9);
+        if (i == ThreadStats::LockStats::HISTOGRAM_SIZE-1) {
+            out << "more";
+        } else {
+            out << (1ULL << (i+8));
+        }
+    }
+    out << endl << "split lock ";
+    for (int i = 0; i < ThreadStats::LockStats::HISTOGRAM_SIZE; i++) {
+        out << setw(9) << totals.splitLock.histogram[i];
+    }
+    out << endl << "pool lock  ";
+    for (int i = 0; i < ThreadStats::LockStats::HISTOGRAM_SIZE; i++) {
+        out << setw(9) << totals.poolLock.histogram[i];
+    }
+    out << endl;
+    out.flags(flags);
+    out.precision(prec);
+}
+#endif
+
 void ThreadPool::resize(unsigned n, SearchController *controller) {
-    if (n >= 1 && n < Constants::MaxCPUs && n != nThreads) {
+    if (controller->srcOpts.thread_affinity != affinity) {
+        // Threads pin themselves and allocate their search state
+        // when they start, so re-create them under the new policy.
+        setAffinity(controller->srcOpts.thread_affinity);
+        const unsigned count = nThreads;
+        resize(1,controller);
+        resize(count,controller);
+    }
+    if (n >= 1 && n <= Constants::MaxCPUs && n != nThreads) {
+        // do not remove threads that are executing a task
+        waitForTask();
         Lock(poolLock);
         if (n>nThreads) {
             // growing
@@ -338,27 +671,27 @@ void ThreadPool::resize(unsigned n, SearchController *controller) {
             // shrinking
             while (n < nThreads) {
                 ThreadInfo *p = data[nThreads-1];
+                data[nThreads-1] = NULL;
+                setIdle(--nThreads);
                 p->state = ThreadInfo::Terminating;
-                if (p->state == ThreadInfo::Idle) {
-                    p->signal(); // unblock thread & exit thread proc
-                    // wait for thread exit
+                // The thread may need the pool lock to reach its exit
+                // point, so release the lock while waiting for it.
+                Unlock(poolLock);
+                p->signal(); // unblock thread & exit thread proc
+                // wait for thread exit
 #ifdef _WIN32
-                    WaitForSingleObject(p->thread_id,INFINITE);
+                WaitForSingleObject(p->thread_id,INFINITE);
 #else
-                    void *value_ptr;
-                    pthread_join(p->thread_id,&value_ptr);
+                void *value_ptr;
+                pthread_join(p->thread_id,&value_ptr);
 #endif
-                }
                 delete p;
-                data[nThreads] = NULL;
-                --nThreads;
+                Lock(poolLock);
             }
         }
         Unlock(poolLock);
     }
     ASSERT(nThreads == n);
-    availableMask = (n == 64) ? 0xffffffffffffffffULL :
-       (1ULL << n)-1;
 }
 
 void ThreadPool::checkIn(ThreadInfo *ti) {
@@ -370,13 +703,13 @@ void ThreadPool::checkIn(ThreadInfo *ti) {
         log(s.str());
     }
 #endif
-    Lock(poolLock);
+    LockTimed(poolLock,ti->stats.poolLock);
     SplitPoint *split = ti->work->split;
     ThreadInfo *parent = split->master;
     Search *parentSearch = parent->work;
     // lock parent's stack
     Lock(parentSearch->splitLock);
-    split->lock();
+    LockTimed(split->mylock,ti->stats.splitLock);
     // dissociate the thread from the parent
     ArasanSet<ThreadInfo *,Constants::MaxCPUs> &slaves =
         split->slaves;
@@ -410,7 +743,7 @@ void ThreadPool::checkIn(ThreadInfo *ti) {
         // Set parent state to Working before it even wakes up. This
         // ensures it will not be allocated to another split point.
         parent->state = ThreadInfo::Working;
-        activeMask |= (1ULL << parent->index);
+        setActive(parent->index);
 #ifdef _THREAD_TRACE
         std::ostringstream s;
         s << "thread " << ti->index <<  
@@ -431,7 +764,180 @@ void ThreadPool::checkIn(ThreadInfo *ti) {
     Unlock(poolLock);
 }
 
-int ThreadPool::activeCount() const {
-   return Bitboard(activeMask & availableMask).bitCount();
+void ThreadPool::attachSearch(ThreadInfo *ti, Search *s) {
+    Lock(poolLock);
+    ti->work = s;
+    // Options changed while the instance was being created were only
+    // passed to threads that already had one, so copy them again.
+    s->setSearchOptions();
+    s->setVariablesFromController();
+    s->setSplitDepthFromController();
+    Unlock(poolLock);
 }
 
+bool ThreadPool::runTask(PoolTask task, void *arg, bool wait, bool helpersOnly) {
+    waitForTask();
+    Lock(poolLock);
+    ThreadInfo *workers[Constants::MaxCPUs];
+    unsigned count = 0;
+    for (unsigned i = 1; i < nThreads; i++) {
+        ThreadInfo *p = data[i];
+        // The Search instance may not exist yet if the thread has
+        // just been created.
+        if (p->state == ThreadInfo::Idle &&
+            (p->work == NULL || !p->work->activeSplitPoints)) {
+            workers[count++] = p;
+        }
+    }
+    if (count == 0) {
+        Unlock(poolLock);
+        if (helpersOnly) return false;
+        // no idle threads, do it all here
+        task(arg,data[0],0,1);
+        return true;
+    }
+    const unsigned first = wait ? 1 : 0;
+    const unsigned slices = count + first;
+    taskDone.reset();
+    pendingTasks = count;
+    for (unsigned i = 0; i < count; i++) {
+        ThreadInfo *p = workers[i];
+        p->task = task;
+        p->taskArg = arg;
+        p->taskSlice = i + first;
+        p->taskSlices = slices;
+        p->state = ThreadInfo::Working;
+        setActive(p->index);
+        p->signal();
+    }
+    Unlock(poolLock);
+    if (wait) {
+        task(arg,data[0],0,slices);
+        waitForTask();
+    }
+    return true;
+}
+
+void ThreadPool::waitForTask() {
+    while (pendingTasks) {
+        taskDone.wait();
+    }
+}
+
+void ThreadPool::setAffinity(const string &policy) {
+    affinity = policy;
+    cpuOrder.clear();
+    if (policy == Options::AFFINITY_NONE) {
+        return;
+    }
+    vector<CpuInfo> cpus;
+    getCpus(cpus);
+    if (policy != Options::AFFINITY_SEQUENTIAL) {
+        std::sort(cpus.begin(),cpus.end(),compactOrder);
+        if (policy == Options::AFFINITY_SCATTER) {
+            for (size_t i = 1; i < cpus.size(); i++) {
+                if (cpus[i].package == cpus[i-1].package) {
+                    if (cpus[i].core == cpus[i-1].core) {
+                        cpus[i].smt = cpus[i-1].smt + 1;
+                        cpus[i].coreRank = cpus[i-1].coreRank;
+                    } else {
+                        cpus[i].coreRank = cpus[i-1].coreRank + 1;
+                    }
+                }
+            }
+            std::sort(cpus.begin(),cpus.end(),scatterOrder);
+        }
+    }
+    for (size_t i = 0; i < cpus.size(); i++) {
+        cpuOrder.push_back(cpus[i].cpu);
+    }
+    if (theLog) {
+        stringstream s;
+        s << "threads: affinity " << policy << ", " << cpuOrder.size() <<
+            " CPU(s)";
+        theLog->write(s.str());
+        theLog->write_eol();
+    }
+}
+
+void ThreadPool::init() {
+   LockInit(cpu_lock);
+#ifdef _THREAD_TRACE
+   LockInit(io_lock);
+#endif
+   // Save the CPUs the process may run on, before any thread is pinned
+#ifdef __linux__
+   if (sched_getaffinity(0,sizeof(processCpus),&processCpus)) {
+      perror("sched_getaffinity");
+   } else {
+      processCpusSaved = true;
+   }
+#elif defined(_WIN32)
+   DWORD_PTR systemCpus;
+   if (!GetProcessAffinityMask(GetCurrentProcess(),&processCpus,&systemCpus)) {
+      cerr << "GetProcessAffinityMask failed" << endl;
+   } else {
+      processCpusSaved = true;
+   }
+#endif
+}
+
+void ThreadPool::cleanup() {
+   LockDestroy(cpu_lock);
+#ifdef _THREAD_TRACE
+   LockDestroy(io_lock);
+#endif
+}
+
+void ThreadPool::bindThread(ThreadInfo *ti) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    if (cpuOrder.empty()) {
+        // not pinned: allow all CPUs the process could originally use
+        if (!processCpusSaved) return;
+        cpus = processCpus;
+    } else {
+        CPU_ZERO(&cpus);
+        CPU_SET(allocCpu(ti),&cpus);
+    }
+    if (pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus)) {
+        perror("pthread_setaffinity_np");
+    }
+#elif defined(_WIN32)
+    DWORD_PTR mask = cpuOrder.empty() ? processCpus :
+        ((DWORD_PTR)1) << allocCpu(ti);
+    if (mask && !SetThreadAffinityMask(GetCurrentThread(),mask)) {
+        cerr << "SetThreadAffinityMask failed" << endl;
+    }
+#endif
+}
+
+int ThreadPool::allocCpu(ThreadInfo *ti) {
+    // Start from the thread's place in the policy order, but take the
+    // first CPU that the fewest pool threads are already pinned to.
+    Lock(cpu_lock);
+    const size_t n = cpuOrder.size();
+    int best = cpuOrder[ti->index % n];
+    unsigned bestUse = cpuUse[best];
+    for (size_t i = 1; i < n && bestUse; i++) {
+        const int cpu = cpuOrder[(ti->index + i) % n];
+        const unsigned use = cpuUse[cpu];
+        if (use < bestUse) {
+            best = cpu;
+            bestUse = use;
+        }
+    }
+    ++cpuUse[best];
+    ti->cpu = best;
+    Unlock(cpu_lock);
+    return best;
+}
+
+void ThreadPool::unbindThread(ThreadInfo *ti) {
+    if (ti->cpu != -1) {
+        Lock(cpu_lock);
+        --cpuUse[ti->cpu];
+        Unlock(cpu_lock);
+        ti->cpu = -1;
+    }
+}
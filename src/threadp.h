@@ -8,6 +8,8 @@
 #include "constant.h"
 
 #include <functional>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -18,6 +20,65 @@ struct SplitPoint;
 
 class ThreadPool;
 
+struct ThreadInfo;
+
+// Work done by pool threads outside of the split-point search, such
+// as clearing the hash table. Each thread is passed its ThreadInfo and
+// the number of its slice of the work.
+typedef void (*PoolTask)(void *arg, ThreadInfo *ti, unsigned slice, unsigned slices);
+
+#ifdef SMP_STATS
+// Counters kept by each thread, for tuning the parallel search.
+// Times are in microseconds unless noted.
+struct ThreadStats {
+   // Waits for a lock that was not free when requested. Wait times
+   // are also counted in a histogram: bucket 0 has waits < 256ns,
+   // bucket i those in [2^(i+7),2^(i+8)) ns, and the last bucket
+   // everything longer.
+   struct LockStats {
+      enum { HISTOGRAM_SIZE = 14 };
+      uint64 waits;
+      uint64 time; // in nanoseconds
+      uint64 histogram[HISTOGRAM_SIZE];
+
+      void add(uint64 nanos);
+      void add(const LockStats &);
+
+      // acquire lock x, recording the wait if it is not free
+      void lock(lock_t &x) {
+         if (!TryLock(x)) {
+            const uint64 start = getCurrentNanos();
+            Lock(x);
+            add(getCurrentNanos()-start);
+         }
+      }
+   };
+
+   ThreadStats() {
+      clear();
+   }
+
+   void clear() {
+      memset(this,'\0',sizeof(ThreadStats));
+   }
+
+   uint64 idleTime;  // time blocked or polling in the idle loop
+   uint64 splits;    // split points created as master
+   uint64 joins;     // split points joined as a slave
+   uint64 startups, startupTime; // checkOut to starting to search
+   uint64 wakeups, wakeLatency;  // start() to starting to search
+   // moves at split points whose search was discarded because of
+   // a cutoff, and the nodes searched for them
+   uint64 abortedMoves, abortedNodes;
+   LockStats splitLock, poolLock;
+};
+
+// Lock x, and count the time waiting for it in LockStats s
+#define LockTimed(x,s) (s).lock(x)
+#else
+#define LockTimed(x,s) Lock(x)
+#endif
+
 struct ThreadInfo : public ThreadControl {
  
    enum State { Idle, Working, Terminating };
@@ -29,6 +90,19 @@ struct ThreadInfo : public ThreadControl {
    ThreadPool *pool;
    THREAD thread_id;
    int index;
+   // CPU the thread is pinned to, or -1 if none
+   int cpu;
+   // task to execute on wakeup, if not NULL
+   PoolTask task;
+   void *taskArg;
+   unsigned taskSlice, taskSlices;
+#ifdef SMP_STATS
+   // Times (from getCurrentMicros) the thread was last checked out,
+   // last signalled by start(), and began waiting in the idle loop.
+   // Each is 0 if not pending.
+   volatile uint64 checkOutTime, signalTime, waitStart;
+   ThreadStats stats;
+#endif
    int operator == (const ThreadInfo &ti) const {
        return index == ti.index;
    }
@@ -57,7 +131,7 @@ public:
 
    // Do a quick check for thread availability (w/o locking)
    int checkAvailable() {
-      return (activeMask & availableMask) != availableMask;
+      return activeThreads < nThreads;
    }
 
    // Threads that are waiting for work execute this function
@@ -66,11 +140,26 @@ public:
    // return a thread to the pool
    void checkIn(ThreadInfo *);
 
-   int activeCount() const;
+   int activeCount() const {
+      return activeThreads;
+   }
 
    // resize the thread pool
    void resize(unsigned n, SearchController *);
 
+   // Run a task in parallel on the idle pool threads. If wait is
+   // true, the calling thread also executes part of the task and
+   // returns when it is complete. Otherwise the call returns at
+   // once and waitForTask() must be used to wait for completion.
+   // If no pool thread is idle, the task is run on the calling
+   // thread, unless helpersOnly is set: then it is not run at all
+   // and false is returned. Should not be called while searching.
+   bool runTask(PoolTask task, void *arg, bool wait,
+                bool helpersOnly = false);
+
+   // wait for completion of a task started with runTask
+   void waitForTask();
+
    template <void (Search::*fn)()>
       void forEachSearch() {
       Lock(poolLock);
@@ -86,22 +175,114 @@ public:
      return controller;
    }
 
+   // Save the process CPU affinity and initialize the locks shared
+   // by all pools. Called once at startup, before any pool is created.
+   static void init();
+
+   static void cleanup();
+
+   // Install the Search instance of a newly started pool thread,
+   // bringing its copy of the controller settings up to date
+   void attachSearch(ThreadInfo *ti, Search *s);
+
+   // Pin the calling thread, which must be ti's, to a CPU according
+   // to the affinity policy, avoiding CPUs already used by threads of
+   // this or other pools where possible.
+   void bindThread(ThreadInfo *ti);
+
+   // Release the CPU a pool thread was pinned to, as it exits
+   void unbindThread(ThreadInfo *ti);
+
+   // Time in microseconds that idle threads poll for work before
+   // blocking (see search.spin_wait). Polling is disabled if there
+   // are more threads than CPUs, since a polling thread could then
+   // delay the thread that is to signal it.
+   unsigned spinTime() const;
+
+#ifdef SMP_STATS
+   // Reset the per-thread statistics, starting a new period
+   void clearStats();
+
+   // Mark the end of the period covered by the statistics
+   void endStats();
+
+   // Get the number of times threads were started at a split point
+   // and the total wakeup latency in microseconds.
+   void getWakeStats(uint64 &wakeups, uint64 &latency) const;
+
+   // Print the per-thread statistics
+   void printStats(ostream &out) const;
+
+   // Update the idle time of a thread when it is done waiting
+   void endWait(ThreadInfo *ti);
+#endif
+
 private:
    void shutDown();
 
-   // lock for the class. Static so idle_loop can access.
-   static LockDefine(poolLock);
+   // compute the CPU order for an affinity policy
+   void setAffinity(const string &policy);
+
+   // choose the CPU to pin a thread to, and record it as in use
+   int allocCpu(ThreadInfo *ti);
+
+   // lock for the class
+   LockDefine(poolLock);
    ThreadInfo * data[Constants::MaxCPUs];
    unsigned nThreads;
 
-   // mask of thread status - 0 if idle, 1 if active
-   static uint64 activeMask;
-   static uint64 availableMask;
+   // count of threads still executing a task
+   volatile unsigned pendingTasks;
+   // signalled when the last task thread completes
+   ThreadControl taskDone;
+
+   enum { MASK_WORDS = (Constants::MaxCPUs+63)/64 };
+
+   // mask of thread status - 0 if idle, 1 if active. Updated only
+   // with poolLock held.
+   uint64 activeMask[MASK_WORDS];
+   // count of bits set in activeMask
+   volatile unsigned activeThreads;
+
+   void setActive(int index) {
+      uint64 &word = activeMask[index/64];
+      const uint64 bit = 1ULL << (index % 64);
+      if (!(word & bit)) {
+         word |= bit;
+         ++activeThreads;
+      }
+   }
+
+   void setIdle(int index) {
+      uint64 &word = activeMask[index/64];
+      const uint64 bit = 1ULL << (index % 64);
+      if (word & bit) {
+         word &= ~bit;
+         --activeThreads;
+      }
+   }
 
 #ifndef _WIN32
    pthread_attr_t stackSizeAttrib;
 #endif
 
+   // current affinity policy, and the CPUs to which threads are
+   // assigned under it (empty if threads are not pinned)
+   string affinity;
+   vector<int> cpuOrder;
+
+   // number of CPUs this process may run on
+   unsigned availableCpus;
+
+#ifdef SMP_STATS
+   // start and end (0 if still running) of the statistics period
+   uint64 statsStart, statsEnd;
+
+   // the part of the interval [start,end) that is in the
+   // statistics period
+   uint64 statsInterval(uint64 start, uint64 end) const;
+#endif
+
    SearchController *controller;
 };
 
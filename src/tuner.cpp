@@ -1344,7 +1344,7 @@ static void parse2(ThreadData &td, Parse2Data &data)
    data.grads.resize(tune_params.numTuningParams(),0.0);
 
    // This is large so allocate on heap:
-   Scoring *s = new Scoring();
+   Scoring *s = new Scoring(options.search);
    const size_t max = tmpdata.size();
    for (;;) {
       // obtain the next available game from the vector
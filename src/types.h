@@ -113,6 +113,33 @@ inline unsigned getElapsedTime(CLOCK_TYPE start,CLOCK_TYPE end) {
   return end - start;
 }
 
+// get a time in nanoseconds, for timing short intervals. Only
+// differences between values are meaningful.
+inline uint64 getCurrentNanos() {
+#if defined(_WIN32)
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return (uint64)((count.QuadPart/freq.QuadPart)*1000000000 +
+                  ((count.QuadPart%freq.QuadPart)*1000000000)/freq.QuadPart);
+#elif defined(_MAC)
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64)tv.tv_sec*1000000000 + (uint64)tv.tv_usec*1000;
+#else
+  struct timespec timeval;
+  if (clock_gettime(CLOCK_MONOTONIC,&timeval)) {
+    perror("clock_gettime");
+  }
+  return (uint64)timeval.tv_sec*1000000000 + timeval.tv_nsec;
+#endif
+}
+
+// as getCurrentNanos, but in microseconds
+inline uint64 getCurrentMicros() {
+  return getCurrentNanos()/1000;
+}
+
 #ifdef _WIN32
 // force _cdecl even if compiler uses fastcall
 #undef CDECL
@@ -173,15 +200,41 @@ inline unsigned getElapsedTime(CLOCK_TYPE start,CLOCK_TYPE end) {
 #define ALIGN_VAR(n)
 #endif
 
+// Non-blocking cache prefetch, used if built with -DUSE_PREFETCH.
+#ifdef USE_PREFETCH
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#define PREFETCH(addr) _mm_prefetch((const char*)(addr),_MM_HINT_T0)
+#else
+#define PREFETCH(addr) __builtin_prefetch((const void*)(addr))
+#endif
+#endif
+
 // multithreading support.
+
+// hint to the CPU that we are in a spin-wait loop
+#if defined(_MSC_VER)
+#define CpuPause() YieldProcessor()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define CpuPause() __builtin_ia32_pause()
+#else
+#define CpuPause()
+#endif
+
 #ifdef _WIN32
 #define LockDefine(x) CRITICAL_SECTION x
 #define lock_t CRITICAL_SECTION
 #define LockInit(x) InitializeCriticalSection(&x)
 #define Lock(x) EnterCriticalSection(&x);
 #define Unlock(x) LeaveCriticalSection(&x);
+// acquire the lock if it is free, returning non-zero if successful
+#define TryLock(x) TryEnterCriticalSection(&x)
 #define LockDestroy(x) DeleteCriticalSection(&x)
 #define LockFree(x) DeleteCriticalSection(&x)
+// atomically add n to x, returning the previous value of x
+#define AtomicFetchAdd(x,n) InterlockedExchangeAdd((volatile LONG*)&(x),(n))
+// atomically add n to the 64-bit value x
+#define AtomicAdd64(x,n) InterlockedExchangeAdd64((volatile LONGLONG*)&(x),(LONGLONG)(n))
 #define THREAD HANDLE
 #elif !_GNUC_PREREQ(4,2)
 // POSIX spinlock, for systems w/o gcc builtins
@@ -191,6 +244,7 @@ inline unsigned getElapsedTime(CLOCK_TYPE start,CLOCK_TYPE end) {
 #define LockInit(x) pthread_spin_init(&x, PTHREAD_PROCESS_PRIVATE)
 #define Lock(x) pthread_spin_lock(&x)
 #define Unlock(x) pthread_spin_unlock(&x)
+#define TryLock(x) (pthread_spin_trylock(&x) == 0)
 #define LockDestroy(x) pthread_spin_destroy(&x)
 #define LockFree(x)
 #else
@@ -205,6 +259,13 @@ static inline void Lock(lock_t &x) {
 static inline void Unlock(lock_t &x) {
    __sync_lock_release(&x);
 }
+static inline int TryLock(lock_t &x) {
+   return !__sync_lock_test_and_set(&x, 1);
+}
+// atomically add n to x, returning the previous value of x
+#define AtomicFetchAdd(x,n) __sync_fetch_and_add(&(x),(n))
+// atomically add n to the 64-bit value x
+#define AtomicAdd64(x,n) __sync_fetch_and_add(&(x),(uint64)(n))
 #define LockDestroy(x)
 #define LockFree(x)
 #define THREAD pthread_t
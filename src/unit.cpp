@@ -13,6 +13,8 @@
 #include "scoring.h"
 #include "search.h"
 #include "globals.h"
+#include "hash.h"
+#include "learn.h"
 
 #include <iostream>
 
@@ -367,6 +369,7 @@ static int testEval() {
     };
     
     int errs = 0;
+    vector<Board> boards;
     for (int i = 0; i < CASES; i++) {
         Board board;
         if (!BoardIO::readFEN(board, fens[i].c_str())) {
@@ -383,8 +386,25 @@ static int testEval() {
             ++errs;
             cerr << "testEval case " << i << " eval mismatch" << endl;
         }
+        // second probe is answered from the eval cache
+        if (s->evalu8(board) != eval2 || s->evalu8(board,false) != eval2) {
+            ++errs;
+            cerr << "testEval case " << i << " eval cache mismatch" << endl;
+        }
         delete s;
+        boards.push_back(board);
+    }
+    // batch eval gives the same scores as evaluating one at a time
+    vector<int> scores(boards.size());
+    Scoring *s = new Scoring();
+    s->evaluateBatch(&boards[0],(int)boards.size(),&scores[0]);
+    for (unsigned i = 0; i < boards.size(); i++) {
+        if (scores[i] != s->evalu8(boards[i],false)) {
+            ++errs;
+            cerr << "testEval batch case " << i << " eval mismatch" << endl;
+        }
     }
+    delete s;
     return errs;
 }
 
@@ -637,6 +657,267 @@ static int testPerft()
 }
 
 
+static int testHash() {
+   int errs = 0;
+   if (sizeof(HashBucket) != 64) {
+      cerr << "testHash: bucket size is " << sizeof(HashBucket) << endl;
+      ++errs;
+   }
+   Hash h;
+   h.initHash(1024*1024);
+   Board board;
+   Move move = CreateMove(board,chess::E2,chess::E4,Empty);
+   const hash_t base = board.hashCode();
+   h.storeHash(base,8*DEPTH_INCREMENT,1,HashEntry::LowerBound,
+               150,25,0,move);
+   HashEntry he;
+   if (h.searchHash(board,base,0,8*DEPTH_INCREMENT,1,he) != HashEntry::LowerBound ||
+       he.getValue() != 150 || he.staticValue() != 25 ||
+       !MovesEqual(he.bestMove(board),move)) {
+      cerr << "testHash: store/search mismatch" << endl;
+      ++errs;
+   }
+   if (h.searchHash(board,base,0,9*DEPTH_INCREMENT,1,he) != HashEntry::Invalid) {
+      cerr << "testHash: expected insufficient depth" << endl;
+      ++errs;
+   }
+   // Mate scores and INVALID_SCORE must survive storage.
+   static const int scores[] = {Constants::MATE-5, -Constants::MATE_RANGE,
+                                Scoring::INVALID_SCORE, -1234};
+   for (int i = 0; i < 4; i++) {
+      HashEntry e(base,scores[i],scores[3-i],0,HashEntry::Valid,1);
+      if (e.getValue() != scores[i] || e.staticValue() != scores[3-i] ||
+          !(e == base)) {
+         cerr << "testHash: score " << scores[i] << " not stored correctly" << endl;
+         ++errs;
+      }
+   }
+   // Fill the bucket with positions that share the same index bits but
+   // have different keys. The shallowest entry should be replaced.
+   HashStats stats;
+   const int n = HashBucket::EntriesPerBucket;
+   for (int i = 1; i <= n; i++) {
+      h.storeHash(base ^ ((hash_t)i << 48),(8+i)*DEPTH_INCREMENT,1,
+                  HashEntry::Valid,i,0,0,NullMove,&stats);
+   }
+   if (h.searchHash(board,base,0,0,1,he,&stats) != HashEntry::NoHit) {
+      cerr << "testHash: shallowest entry was not replaced" << endl;
+      ++errs;
+   }
+   for (int i = 1; i <= n; i++) {
+      if (h.searchHash(board,base ^ ((hash_t)i << 48),0,0,1,he,&stats) != HashEntry::Valid ||
+          he.getValue() != i) {
+         cerr << "testHash: missing entry " << i << endl;
+         ++errs;
+      }
+   }
+   if (stats.stores != (uint64)n || stats.emptyFills != (uint64)n-1 ||
+       stats.replaced[0][HashStats::DEPTH_BINS-1] != 1 ||
+       stats.probes != (uint64)n+1 ||
+       stats.results[HashEntry::NoHit] != 1 ||
+       stats.results[HashEntry::Valid] != (uint64)n) {
+      cerr << "testHash: incorrect statistics" << endl;
+      ++errs;
+   }
+   // A move for the wrong side shows a key collision.
+   h.storeHash(base,12*DEPTH_INCREMENT,1,HashEntry::Valid,0,0,0,
+               CreateMove(board,chess::E7,chess::E5,Empty));
+   h.searchHash(board,base,0,0,1,he,&stats);
+   if (stats.collisions != 1) {
+      cerr << "testHash: collision not detected" << endl;
+      ++errs;
+   }
+   h.freeHash();
+   return errs;
+}
+
+static int testHashResize() {
+   int errs = 0;
+   Hash h;
+   h.initHash(1024*1024);
+   Board board;
+   static const int N = 1000;
+   hash_t keys[N];
+   int found[N];
+   hash_t x = 0x9e3779b97f4a7c15ULL;
+   for (int i = 0; i < N; i++) {
+      // xorshift, for well-distributed keys
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      keys[i] = x;
+      h.storeHash(keys[i],(i%20)*DEPTH_INCREMENT,1,HashEntry::Valid,
+                  i,0,0,NullMove);
+   }
+   HashEntry he;
+   // growing: all entries kept
+   h.resizeHash(4*1024*1024,1);
+   for (int i = 0; i < N; i++) {
+      if (h.searchHash(board,keys[i],0,0,1,he) != HashEntry::Valid ||
+          he.getValue() != i || he.depth() != (i%20)*DEPTH_INCREMENT) {
+         cerr << "testHashResize: entry " << i << " lost in grow" << endl;
+         ++errs;
+         break;
+      }
+   }
+   // extra copies made by the grow are not counted as full: the
+   // occupancy reflects the entries kept, in a table 4x as large
+   {
+      Hash full;
+      full.initHash(1024*1024);
+      hash_t y = 0x2545f4914f6cdd1dULL;
+      for (int i = 0; i < 40000; i++) {
+         y ^= y << 13; y ^= y >> 7; y ^= y << 17;
+         full.storeHash(y,(i%20)*DEPTH_INCREMENT,1,HashEntry::Valid,
+                        i,0,0,NullMove);
+      }
+      const int before = full.pctFull();
+      full.resizeHash(4*1024*1024,1);
+      const int after = full.pctFull();
+      if (before == 0 || Util::Abs(4*after - before) > before/5) {
+         cerr << "testHashResize: hashfull " << before << " before grow, " <<
+            after << " after" << endl;
+         ++errs;
+      }
+      full.freeHash();
+   }
+   // shrinking to fewer slots than entries: an entry may only be
+   // dropped if its bucket is full of entries at least as deep.
+   static const size_t SMALL = 16*1024;
+   h.resizeHash(SMALL,1);
+   const hash_t mask = SMALL/sizeof(HashBucket)-1;
+   int kept = 0;
+   for (int i = 0; i < N; i++) {
+      found[i] = h.searchHash(board,keys[i],0,0,1,he) == HashEntry::Valid;
+      kept += found[i];
+   }
+   if (kept == 0 || kept > (int)(SMALL/sizeof(HashBucket))*HashBucket::EntriesPerBucket) {
+      cerr << "testHashResize: " << kept << " entries kept after shrink" << endl;
+      ++errs;
+   }
+   for (int i = 0; i < N && !errs; i++) {
+      if (found[i]) continue;
+      int deeper = 0;
+      for (int j = 0; j < N; j++) {
+         if (found[j] && (keys[j] & mask) == (keys[i] & mask) &&
+             j%20 >= i%20) {
+            deeper++;
+         }
+      }
+      if (deeper < HashBucket::EntriesPerBucket) {
+         cerr << "testHashResize: deeper entry dropped in shrink" << endl;
+         ++errs;
+      }
+   }
+   h.freeHash();
+   return errs;
+}
+
+static int testHashFile() {
+   int errs = 0;
+   const string fileName = derivePath("unit_test.hsh");
+   Hash h;
+   h.initHash(1024*1024);
+   Board board;
+   static const int N = 1000;
+   hash_t keys[N];
+   hash_t x = 0x9e3779b97f4a7c15ULL;
+   for (int i = 0; i < N; i++) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      keys[i] = x;
+      h.storeHash(keys[i],(i%20)*DEPTH_INCREMENT,1,HashEntry::Valid,
+                  i,0,0,NullMove);
+   }
+   if (h.saveHash(fileName)) {
+      cerr << "testHashFile: save failed" << endl;
+      h.freeHash();
+      return 1;
+   }
+   h.freeHash();
+   // Load into a table of the same size, and into a larger one
+   // (entries are migrated). Loaded entries get the new age, and
+   // must still pass the key check.
+   static const size_t sizes[2] = {1024*1024, 4*1024*1024};
+   for (int s = 0; s < 2; s++) {
+      Hash loaded;
+      loaded.initHash(sizes[s]);
+      if (loaded.loadHash(fileName,7)) {
+         cerr << "testHashFile: load failed, size " << sizes[s] << endl;
+         ++errs;
+      } else {
+         HashEntry he;
+         for (int i = 0; i < N; i++) {
+            if (loaded.searchHash(board,keys[i],0,0,7,he) != HashEntry::Valid ||
+                he.getValue() != i || he.depth() != (i%20)*DEPTH_INCREMENT ||
+                he.age() != 7) {
+               cerr << "testHashFile: entry " << i << " not loaded, size " <<
+                  sizes[s] << endl;
+               ++errs;
+               break;
+            }
+         }
+      }
+      loaded.freeHash();
+   }
+   remove(fileName.c_str());
+   return errs;
+}
+
+static int testLearnFile() {
+   int errs = 0;
+   const string saveName = learnFileName;
+   learnFileName = derivePath("unit_test.lrb");
+   remove(learnFileName.c_str());
+   static const int N = 3000;
+   vector<hash_t> keys;
+   hash_t x = 0x9e3779b97f4a7c15ULL;
+   for (int i = 0; i < N; i++) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      keys.push_back(x);
+      LearnRecord rec;
+      rec.hashcode = x;
+      rec.in_check = 0;
+      rec.score = i;
+      rec.depth = 10;
+      rec.start = rec.dest = InvalidSquare;
+      rec.promotion = Empty;
+      addLearnRecord(rec);
+   }
+   // first write is sorted
+   flushLearnRecords();
+   // records for positions already in the file are appended, and
+   // take precedence
+   for (int i = 0; i < 10; i++) {
+      LearnRecord rec;
+      rec.hashcode = keys[i*100];
+      rec.in_check = 0;
+      rec.score = -1;
+      rec.depth = 12;
+      rec.start = rec.dest = InvalidSquare;
+      rec.promotion = Empty;
+      addLearnRecord(rec);
+   }
+   flushLearnRecords();
+   // not in the file:
+   keys.push_back(0x0123456789abcdefULL);
+   vector<LearnRecord> found;
+   findLearnRecords(keys,found);
+   if (found.size() != N) {
+      cerr << "testLearnFile: " << found.size() << " records found" << endl;
+      ++errs;
+   } else {
+      for (int i = 0; i < N; i++) {
+         const int expected = (i % 100 == 0 && i < 1000) ? -1 : i;
+         if (found[i].hashcode != keys[i] || found[i].score != expected) {
+            cerr << "testLearnFile: wrong record " << i << endl;
+            ++errs;
+            break;
+         }
+      }
+   }
+   remove(learnFileName.c_str());
+   learnFileName = saveName;
+   return errs;
+}
+
 int doUnit() {
 
    int errs = 0;
@@ -649,5 +930,9 @@ int doUnit() {
    errs += testDrawEval();
    errs += testCheckStatus();
    errs += testPerft();
+   errs += testHash();
+   errs += testHashResize();
+   errs += testHashFile();
+   errs += testLearnFile();
    return errs;
 }